@@ -5,6 +5,7 @@ MODULES = \
 	  opbot \
 	  privileges \
 	  snote \
+	  stats \
 	  userlist \
 	  voicebot \
 	  whoami \
@@ -18,14 +19,16 @@ MODULES = \
 	  core/oper \
 	  core/ping \
 	  logs/channel \
+	  logs/file \
 	  logs/stderr \
 	  privs/account \
 	  privs/hostmask \
-	  storage/json
+	  storage/binary \
+	  storage/journal \
+	  storage/json \
+	  $(ENABLE_SQLITE)
 
-storage/json_CXXFLAGS = -Ilibjson
-storage/json_LDFLAGS = -Wl,-rpath,$(LIBDIR)
-storage/json_LIBRARIES = libjson/json
+storage/sqlite_LDFLAGS = $(SQLITE_LIBS)
 
 SUBDIRS = $(ENABLE_PERL)
 
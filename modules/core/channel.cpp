@@ -1,5 +1,6 @@
 #include "eir.h"
 #include "handler.h"
+#include "pool_allocator.h"
 
 #include <functional>
 
@@ -18,12 +19,13 @@ struct ChannelHandler : CommandHandlerBase<ChannelHandler>, Module
     void handle_nick(const Message *);
     void handle_kick(const Message *);
     void handle_account(const Message *);
+    void handle_chghost(const Message *);
     void handle_who_reply(const Message *);
     void handle_whox_reply(const Message *);
 
     ChannelHandler();
 
-    CommandHolder join_id, part_id, quit_id, names_id, nick_id, account_id, who_id, whox_id, kick_id;
+    CommandHolder join_id, part_id, quit_id, names_id, nick_id, account_id, chghost_id, who_id, whox_id, kick_id;
 };
 
 ChannelHandler::ChannelHandler()
@@ -34,6 +36,7 @@ ChannelHandler::ChannelHandler()
     //names_id = add_handler("353", sourceinfo::RawIrc, &ChannelHandler::handle_names_reply);
     nick_id = add_handler(filter_command_type("NICK", sourceinfo::RawIrc), &ChannelHandler::handle_nick);
     account_id = add_handler(filter_command_type("ACCOUNT", sourceinfo::RawIrc), &ChannelHandler::handle_account);
+    chghost_id = add_handler(filter_command_type("CHGHOST", sourceinfo::RawIrc), &ChannelHandler::handle_chghost);
     who_id = add_handler(filter_command_type("352", sourceinfo::RawIrc), &ChannelHandler::handle_who_reply);
     whox_id = add_handler(filter_command_type("354", sourceinfo::RawIrc), &ChannelHandler::handle_whox_reply);
     kick_id = add_handler(filter_command_type("KICK", sourceinfo::RawIrc), &ChannelHandler::handle_kick);
@@ -47,7 +50,7 @@ namespace
 
         if(!c)
         {
-            c.reset(new Client(b, nick, user, host));
+            c = std::allocate_shared<Client>(PoolAllocator<Client>(), b, nick, user, host);
             b->add_client(c);
         }
 
@@ -79,7 +82,7 @@ namespace
                 host = nuh.substr(at + 1, std::string::npos);
             }
 
-            c.reset(new Client(b, nick, user, host));
+            c = std::allocate_shared<Client>(PoolAllocator<Client>(), b, nick, user, host);
             b->add_client(c);
         }
 
@@ -101,7 +104,7 @@ namespace
 
         if (!ch)
         {
-            ch.reset(new Channel(name));
+            ch = std::allocate_shared<Channel>(PoolAllocator<Channel>(), b, name);
             b->add_channel(ch);
         }
         return ch;
@@ -194,6 +197,7 @@ static void who_reply_common(const Message *m,
 {
     Context ctx("Processing WHO reply for " + chname + " (" + nick + ")");
     Client::ptr c = find_or_create_client(m->bot, nick, user, hostname);
+    c->set_userhost(user, hostname);
 
     if (m->bot->use_account_tracking() && !account.empty())
         c->set_account(account);
@@ -204,8 +208,8 @@ static void who_reply_common(const Message *m,
     for (std::string::iterator ch = flags.begin(); ch != flags.end(); ++ch)
     {
         char c = m->bot->supported()->get_prefix_mode(*ch);
-        if (c && !member->has_mode(c))
-            member->modes += c;
+        if (c)
+            member->add_mode(c);
     }
 }
 
@@ -282,13 +286,16 @@ void ChannelHandler::handle_quit(const Message *m)
     if (!c)
         return;
 
-    for (Client::ChannelIterator chi = c->begin_channels(), che = c->end_channels();
-            chi != che; ++chi)
-        c->leave_chan(*chi);
+    Client::ChannelIterator chi = c->begin_channels();
+    while (chi != c->end_channels())
+    {
+        Membership::ptr p = *chi++;
+        c->leave_chan(p);
+    }
 
     b->remove_client(c);
 
-    Logger::get_instance()->Log(b, c, Logger::Debug, "QUIT: " + c->nick());
+    Logger::get_instance()->Log(b, c, Logger::Debug, [&] { return "QUIT: " + c->nick(); });
 }
 
 void ChannelHandler::handle_nick(const Message *m)
@@ -312,4 +319,14 @@ void ChannelHandler::handle_account(const Message *m)
     m->source.client->set_account(newaccount);
 }
 
+void ChannelHandler::handle_chghost(const Message *m)
+{
+    Context ctx("Handling host change from " + m->source.name);
+
+    if (!m->source.client || m->args.empty())
+        return;
+
+    m->source.client->set_userhost(m->source.destination, m->args[0]);
+}
+
 MODULE_CLASS(ChannelHandler)
@@ -30,10 +30,10 @@ struct ModeParser : CommandHandlerBase<ModeParser>, Module
             if (!mem)
                 return;
 
-            if (m->args[0] == "add" && !mem->has_mode(m->args[1][0]))
-                mem->modes += m->args[1][0];
-            else if (m->args[0] == "remove" && mem->has_mode(m->args[1][0]))
-                mem->modes.erase(mem->modes.find(m->args[1][0]));
+            if (m->args[0] == "add")
+                mem->add_mode(m->args[1][0]);
+            else if (m->args[0] == "remove")
+                mem->remove_mode(m->args[1][0]);
         }
     }
 
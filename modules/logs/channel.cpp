@@ -10,7 +10,7 @@ struct ChannelLogger : public Module
 
         void Log(Bot *b, Client *c, std::string text)
         {
-            if (b->connected())
+            if (b && b->connected())
                 b->send("PRIVMSG " + channel + " :(" + (c ? c->nick() : "<unknown>") + ") " + text);
         }
 
@@ -0,0 +1,363 @@
+#include "eir.h"
+
+#include <paludis/util/stringify.hh>
+#include <paludis/util/destringify.hh>
+
+#include <atomic>
+#include <cstring>
+#include <cstdio>
+#include <ctime>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdint.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+using namespace eir;
+
+namespace
+{
+    // Bumped by SIGHUP; each destination reopens its file when it sees a change.
+    std::atomic<unsigned int> hangups(0);
+
+    void on_sighup(int)
+    {
+        ++hangups;
+    }
+
+    enum TimestampFormat { TextTimestamps, BinaryTimestamps, NoTimestamps };
+
+    struct FileOptions
+    {
+        TimestampFormat timestamps;
+        bool daily;
+        off_t max_size;
+        unsigned int keep;
+
+        FileOptions()
+            : timestamps(TextTimestamps), daily(false), max_size(0), keep(5)
+        { }
+    };
+
+    long day_of(time_t t)
+    {
+        struct tm tm;
+        localtime_r(&t, &tm);
+        return (tm.tm_year + 1900) * 10000L + (tm.tm_mon + 1) * 100 + tm.tm_mday;
+    }
+}
+
+struct FileLogger : public CommandHandlerBase<FileLogger>, Module
+{
+    /*
+     * Each record is queued with the time it was logged, as eight bytes of
+     * microseconds since the epoch, in front of the text; the logging thread
+     * writes that out as it was asked to, and decides when to rotate.
+     * Output is collected and written with O_APPEND once there's enough of it,
+     * or once it's been waiting for a second.
+     */
+    struct Destination : public AsyncLogDestination
+    {
+        enum { flush_size = 64 * 1024 };
+
+        std::string filename;
+        FileOptions options;
+        int fd;
+        off_t size;
+        long day;
+        unsigned int seen_hangups;
+        std::string buffer;
+        time_t last_write, text_time, day_checked;
+        char text_stamp[32];
+
+        std::string format(Bot *b, Client *, const std::string & text)
+        {
+            struct timeval tv;
+            gettimeofday(&tv, NULL);
+            uint64_t usec = uint64_t(tv.tv_sec) * 1000000 + tv.tv_usec;
+
+            std::string record(8, '\0');
+            for (int i = 0; i < 8; ++i)
+                record[i] = char(usec >> (8 * i));
+
+            if (b)
+                record += "[" + b->name() + "] ";
+
+            std::string::size_type p = text.rfind("\r\n");
+            if (p == std::string::npos)
+                p = text.rfind("\n");
+            record.append(text, 0, p);
+            record += '\n';
+            return record;
+        }
+
+        void write(const std::string & record)
+        {
+            uint64_t usec = 0;
+            for (int i = 7; i >= 0; --i)
+                usec = (usec << 8) | (unsigned char)record[i];
+            time_t t = usec / 1000000;
+
+            if (options.daily && t != day_checked)
+            {
+                day_checked = t;
+                if (day_of(t) != day)
+                    rotate(t);
+            }
+
+            switch (options.timestamps)
+            {
+                case BinaryTimestamps:
+                    buffer += record;
+                    break;
+
+                case TextTimestamps:
+                    if (t != text_time)
+                    {
+                        struct tm tm;
+                        localtime_r(&t, &tm);
+                        strftime(text_stamp, sizeof text_stamp, "%Y-%m-%d %H:%M:%S ", &tm);
+                        text_time = t;
+                    }
+                    buffer += text_stamp;
+                    buffer.append(record, 8, std::string::npos);
+                    break;
+
+                case NoTimestamps:
+                    buffer.append(record, 8, std::string::npos);
+                    break;
+            }
+
+            if (options.max_size && size + off_t(buffer.size()) >= options.max_size)
+                rotate(t);
+            else if (buffer.size() >= flush_size)
+                write_out();
+        }
+
+        void flush()
+        {
+            if (hangups != seen_hangups)
+            {
+                seen_hangups = hangups;
+                write_out();
+                reopen();
+            }
+
+            if (!buffer.empty() && time(NULL) - last_write >= 1)
+                write_out();
+        }
+
+        void write_out()
+        {
+            std::string::size_type done = 0;
+            while (done < buffer.size())
+            {
+                ssize_t n = ::write(fd, buffer.data() + done, buffer.size() - done);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                {
+                    complain("Couldn't write to log file " + filename + ": " + strerror(errno));
+                    break;
+                }
+                done += n;
+            }
+            size += done;
+            buffer.clear();
+            last_write = time(NULL);
+        }
+
+        // Anything still buffered belongs to the file being closed, so it's
+        // written out first. The file ends up with the date it covers for daily
+        // rotation, or with a number, older files having higher ones.
+        void rotate(time_t now)
+        {
+            write_out();
+
+            if (size > 0)
+            {
+                if (options.daily && day != day_of(now))
+                {
+                    std::rename(filename.c_str(), (filename + "." + paludis::stringify(day)).c_str());
+                }
+                else
+                {
+                    for (unsigned int i = options.keep; i > 1; --i)
+                        std::rename((filename + "." + paludis::stringify(i - 1)).c_str(),
+                                    (filename + "." + paludis::stringify(i)).c_str());
+                    std::rename(filename.c_str(), (filename + ".1").c_str());
+                }
+            }
+
+            reopen();
+            day = day_of(now);
+        }
+
+        void reopen()
+        {
+            int newfd = open(filename.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+            if (newfd < 0)
+            {
+                // Keep writing to the old file rather than losing everything.
+                complain("Couldn't reopen log file " + filename + ": " + strerror(errno));
+                return;
+            }
+
+            if (fd >= 0)
+                close(fd);
+            fd = newfd;
+
+            struct stat st;
+            size = fstat(fd, &st) == 0 ? st.st_size : 0;
+        }
+
+        // There's nowhere better to report problems from the logging thread.
+        void complain(const std::string & message)
+        {
+            std::string line = message + "\n";
+            if (::write(2, line.data(), line.size()) < 0)
+                return;
+        }
+
+        Destination(const std::string & f, const FileOptions & o)
+            : filename(f), options(o), fd(-1), size(0), seen_hangups(hangups),
+              last_write(time(NULL)), text_time(-1), day_checked(-1)
+        {
+            fd = open(filename.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+            if (fd < 0)
+                throw ConfigurationError("Couldn't open log file " + filename + ": " + strerror(errno));
+
+            struct stat st;
+            if (fstat(fd, &st) == 0)
+            {
+                size = st.st_size;
+                day = day_of(st.st_size ? st.st_mtime : time(NULL));
+            }
+            else
+                day = day_of(time(NULL));
+        }
+
+        ~Destination()
+        {
+            write_out();
+            close(fd);
+        }
+    };
+
+    struct Backend : public LogBackend
+    {
+        FileLogger *module;
+
+        LogDestination *create_destination(std::string filename)
+        {
+            if (filename.empty() || filename[0] != '/')
+                filename = DATADIR "/" + filename;
+            return new Destination(filename, module->options);
+        }
+
+        Backend(FileLogger *m)
+            : module(m)
+        { }
+    };
+
+    // These apply to file logs created after them.
+    FileOptions options;
+
+    static long long number_or_zero(const std::string & s)
+    {
+        try
+        {
+            return paludis::destringify<long long>(s);
+        }
+        catch (paludis::DestringifyError &)
+        {
+            return 0;
+        }
+    }
+
+    void set_rotate(const Message *m)
+    {
+        if (m->args.empty())
+            return;
+
+        if (m->args[0] == "daily")
+        {
+            options.daily = true;
+            options.max_size = 0;
+        }
+        else if (m->args[0] == "size" && m->args.size() > 1)
+        {
+            long long max_size = number_or_zero(m->args[1]);
+            long long keep = m->args.size() > 2 ? number_or_zero(m->args[2]) : options.keep;
+
+            // A size of zero or less would rotate on every line.
+            if (max_size <= 0)
+                throw ConfigurationError("log_file_rotate size needs a positive number of bytes, not " + m->args[1]);
+            if (keep < 1 || keep > 1000)
+                throw ConfigurationError("log_file_rotate size needs between 1 and 1000 files to keep");
+
+            options.daily = false;
+            options.max_size = max_size;
+            options.keep = keep;
+        }
+        else if (m->args[0] == "none")
+        {
+            options.daily = false;
+            options.max_size = 0;
+        }
+        else
+            Logger::get_instance()->Log(NULL, NULL, Logger::Warning,
+                    "Unknown log_file_rotate " + m->args[0] + "; expected daily, size <bytes> [<count>] or none");
+    }
+
+    void set_timestamps(const Message *m)
+    {
+        if (m->args.empty())
+            return;
+
+        if (m->args[0] == "text")
+            options.timestamps = TextTimestamps;
+        else if (m->args[0] == "binary")
+            options.timestamps = BinaryTimestamps;
+        else if (m->args[0] == "none")
+            options.timestamps = NoTimestamps;
+        else
+            Logger::get_instance()->Log(NULL, NULL, Logger::Warning,
+                    "Unknown log_file_timestamps " + m->args[0] + "; expected text, binary or none");
+    }
+
+    void clear_options(const Message *)
+    {
+        options = FileOptions();
+    }
+
+    LogBackendHolder id;
+    CommandHolder rotate_id, timestamps_id, clear_id;
+    struct sigaction old_sighup;
+
+    FileLogger()
+    {
+        rotate_id = add_handler(filter_command_type("log_file_rotate", sourceinfo::ConfigFile), &FileLogger::set_rotate);
+        timestamps_id = add_handler(filter_command_type("log_file_timestamps", sourceinfo::ConfigFile), &FileLogger::set_timestamps);
+        clear_id = add_handler(filter_command_type("clear_lists", sourceinfo::Internal), &FileLogger::clear_options);
+
+        struct sigaction sa;
+        memset(&sa, 0, sizeof sa);
+        sa.sa_handler = on_sighup;
+        sa.sa_flags = SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGHUP, &sa, &old_sighup);
+
+        id = Logger::get_instance()->register_backend("file", new Backend(this));
+    }
+
+    ~FileLogger()
+    {
+        sigaction(SIGHUP, &old_sighup, NULL);
+    }
+};
+
+MODULE_CLASS(FileLogger)
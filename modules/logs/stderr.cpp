@@ -1,28 +1,50 @@
 #include "eir.h"
 
-#include <iostream>
+#include <unistd.h>
+#include <errno.h>
 
 using namespace eir;
 
 struct StdErrLogger : public Module
 {
-    struct Destination : public LogDestination
+    // Lines are collected and written out a batch at a time by the logging
+    // thread, instead of being flushed one by one.
+    struct Destination : public AsyncLogDestination
     {
-        void Log(Bot *b, Client *, std::string text)
+        std::string buffer;
+
+        std::string format(Bot *b, Client *, const std::string & text)
         {
             std::string::size_type p = text.rfind("\r\n");
-            if(p != std::string::npos)
-                text = text.substr(0, p);
-            else
-            {
+            if (p == std::string::npos)
                 p = text.rfind("\n");
-                if (p != std::string::npos)
-                    text = text.substr(0, p);
-            }
 
+            std::string line;
             if (b)
-                std::cerr << "[" << b->name() << "] ";
-            std::cerr << text << std::endl;
+                line = "[" + b->name() + "] ";
+            line.append(text, 0, p);
+            line += '\n';
+            return line;
+        }
+
+        void write(const std::string & line)
+        {
+            buffer += line;
+        }
+
+        void flush()
+        {
+            std::string::size_type done = 0;
+            while (done < buffer.size())
+            {
+                ssize_t n = ::write(2, buffer.data() + done, buffer.size() - done);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                    break;
+                done += n;
+            }
+            buffer.clear();
         }
     };
 
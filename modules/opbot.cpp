@@ -78,10 +78,23 @@ namespace
         "\037reason\037 is given but \037time\037 is not, then the expiry will be left unchanged.";
 
 
+    // Every list entry has the same fields, so they're stored as records.
+    RecordSchema::ptr entry_schema()
+    {
+        static RecordSchema::ptr schema = RecordSchema::get({"bot", "mask", "setter", "reason", "set", "expires"});
+        return schema;
+    }
+
+    RecordSchema::ptr lost_entry_schema()
+    {
+        static RecordSchema::ptr schema = RecordSchema::get({"bot", "mask", "expires"});
+        return schema;
+    }
+
     Value opentry(std::string bot, std::string mask, std::string setter, std::string reason,
                      time_t set, time_t expires)
     {
-        Value v(Value::kvarray);
+        Value v = entry_schema()->make();
         v["bot"] = bot;
         v["mask"] = mask;
         v["setter"] = setter;
@@ -93,7 +106,7 @@ namespace
 
     Value lostopentry(std::string bot, std::string mask, time_t expires)
     {
-        Value v(Value::kvarray);
+        Value v = lost_entry_schema()->make();
         v["bot"] = bot;
         v["mask"] = mask;
         v["expires"] = expires;
@@ -104,15 +117,32 @@ namespace
     {
         bool operator() (const Value& v)
         {
-            return v.Type() == Value::kvarray && v.KV().find("removed") != v.KV().end();
+            return v.Type() == Value::kvarray && v["removed"].Type() != Value::empty;
         }
     };
 
-    void do_removals(Value& list)
+    // Only takes non-const access to the list, which marks it as changed, if
+    // there's something to remove. If an expiry sweep is part way through the
+    // list, sweep_pos is moved back past the entries removed before it, so
+    // that it keeps its place.
+    void do_removals(Value& list, size_t *sweep_pos = NULL)
     {
-        Value newlist(Value::array);
-        std::remove_copy_if(list.begin(), list.end(), std::back_inserter(newlist.Array()), Removed());
-        std::swap(list, newlist);
+        const ValueArray &current = static_cast<const Value&>(list).Array();
+        if (std::find_if(current.begin(), current.end(), Removed()) == current.end())
+            return;
+
+        if (sweep_pos)
+        {
+            size_t before = 0;
+            for (size_t i = 0; i < *sweep_pos && i < current.size(); ++i)
+                if (Removed()(current[i]))
+                    ++before;
+            *sweep_pos -= before;
+        }
+
+        ValueArray &entries = list.Array();
+        ValueArray::iterator kept_end = std::remove_if(entries.begin(), entries.end(), Removed());
+        entries.resize(std::distance(entries.begin(), kept_end));
     }
 }
 
@@ -168,7 +198,8 @@ struct opbot : CommandHandlerBase<opbot>, Module
         if (mask.find_first_of("!@*") == std::string::npos)
             mask += "!*@*";
 
-        for (ValueArray::iterator it = dno.begin(); it != dno.end(); ++it)
+        const Value &entries = dno;
+        for (ValueArray::const_iterator it = entries.begin(); it != entries.end(); ++it)
         {
             if (mask_match((*it)["mask"], mask))
             {
@@ -254,14 +285,15 @@ struct opbot : CommandHandlerBase<opbot>, Module
             }
         }
 
-        do_removals(dno);
+        do_removals(dno, &expiry_dno_pos);
 
         Logger::get_instance()->Log(m->bot, m->source.client, Logger::Command, "REMOVE " + mask);
     }
 
     void do_list(const Message *m)
     {
-        for (ValueArray::iterator it = dno.begin(); it != dno.end(); ++it)
+        const Value &entries = dno;
+        for (ValueArray::const_iterator it = entries.begin(); it != entries.end(); ++it)
         {
             Bot *bot = BotManager::get_instance()->find((*it)["bot"]);
             m->source.reply((*it)["mask"] + " (" + (*it)["reason"] + ") (added by " +
@@ -276,13 +308,17 @@ struct opbot : CommandHandlerBase<opbot>, Module
                            std::list<std::string> *toop,
                            std::list<std::string> *tonotop)
     {
+        if (channel->mode_count('o') == channel->member_count())
+            return;
+
         for (Channel::MemberIterator it = channel->begin_members(); it != channel->end_members(); ++it)
         {
             if ((*it)->has_mode('o'))
                 continue;
 
             bool matched = false;
-            for (ValueArray::iterator i2 = dno.begin(); i2 != dno.end(); ++i2)
+            const Value &entries = dno;
+            for (ValueArray::const_iterator i2 = entries.begin(); i2 != entries.end(); ++i2)
             {
                 if (match((*i2)["mask"], (*it)->client->nuh()))
                 {
@@ -390,7 +426,8 @@ struct opbot : CommandHandlerBase<opbot>, Module
                 mask = c->nuh();
         }
 
-        for (ValueArray::iterator it = dno.begin(); it != dno.end(); ++it)
+        const Value &entries = dno;
+        for (ValueArray::const_iterator it = entries.begin(); it != entries.end(); ++it)
             if (mask_match((*it)["mask"], mask))
             {
                 Bot *bot = BotManager::get_instance()->find((*it)["bot"]);
@@ -402,69 +439,111 @@ struct opbot : CommandHandlerBase<opbot>, Module
         m->source.reply("*** End of DNO matches for " + mask);
     }
 
+    // The expiry sweep runs as an idle task, a chunk of entries at a time, so
+    // that large lists don't stall the main loop while they're checked.
+    // Each list has its own position, so that adding to one doesn't move the
+    // other, and do_removals keeps it in step when it compacts the list.
+    enum { expiry_chunk = 128 };
+    size_t expiry_dno_pos, expiry_lostops_pos;
+
     void check_expiry()
     {
-        time_t currenttime = time(NULL);
-
-        for (ValueArray::iterator it = dno.begin(); it != dno.end(); ++it)
-        {
-            if ((*it)["expires"].Int() != 0 && (*it)["expires"].Int() < currenttime)
-            {
-                Bot *bot = BotManager::get_instance()->find((*it)["bot"]);
-                std::string adminchan;
-                if (bot)
-                    adminchan = bot->get_setting("opbot_admin_channel");
+        expiry_dno_pos = expiry_lostops_pos = 0;
+        expiry_task = add_idle_task(&opbot::check_expiry_step, 2);
+    }
 
-                if (bot && !adminchan.empty())
-                    bot->send("NOTICE " + adminchan + " :Removing expired entry " +
-                            (*it)["mask"] + " added by " + (*it)["setter"] + " on " +
-                            format_time(bot, (*it)["set"].Int()));
+    static bool expired(const Value & entry, time_t currenttime)
+    {
+        return entry["expires"].Int() != 0 && entry["expires"].Int() < currenttime;
+    }
 
-                old.push_back(*it);
-                (*it)["removed"] = 1;
-            }
-        }
-        for (ValueArray::iterator it = lostops.begin(); it != lostops.end(); ++it)
+    void expire_entry(Value & entry, time_t currenttime)
+    {
+        if (expired(entry, currenttime))
         {
-            if ((*it)["expires"].Int() != 0 && (*it)["expires"].Int() < currenttime)
-            {
-                (*it)["removed"] = 1;
-            }
+            Bot *bot = BotManager::get_instance()->find(entry["bot"]);
+            std::string adminchan;
+            if (bot)
+                adminchan = bot->get_setting("opbot_admin_channel");
+
+            if (bot && !adminchan.empty())
+                bot->send("NOTICE " + adminchan + " :Removing expired entry " +
+                        entry["mask"] + " added by " + entry["setter"] + " on " +
+                        format_time(bot, entry["set"].Int()));
+
+            old.push_back(entry);
+            entry["removed"] = 1;
         }
-
-        do_removals(dno);
-        do_removals(lostops);
     }
 
-    void load_list(Value & v, std::string name)
+    void expire_lost_entry(Value & entry, time_t currenttime)
     {
-        try
-        {
-            v = StorageManager::get_instance()->Load(name);
-            if (v.Type() != Value::array)
-                throw "wrong type";
-        }
-        catch (StorageError &)
+        if (expired(entry, currenttime))
         {
-            v = Value(Value::array);
+            entry["removed"] = 1;
         }
-        catch (IOError &)
+    }
+
+    bool check_expiry_step()
+    {
+        time_t currenttime = time(NULL);
+        const Value &cdno = dno, &clostops = lostops;
+        size_t n_dno = cdno.Array().size(), n_lostops = clostops.Array().size();
+
+        // Most entries won't have expired, so look at them through const access
+        // and only modify the lists when something has.
+        for (int i = 0; i < expiry_chunk && expiry_dno_pos < n_dno; ++i, ++expiry_dno_pos)
         {
-            v = Value(Value::array);
+            const Value & entry = cdno.Array()[expiry_dno_pos];
+
+            // Entries already dealt with may not have been swept out of the list yet.
+            if (!Removed()(entry) && expired(entry, currenttime))
+                expire_entry(dno.Array()[expiry_dno_pos], currenttime);
         }
-        catch (const char *)
+
+        for (int i = 0; i < expiry_chunk && expiry_lostops_pos < n_lostops; ++i, ++expiry_lostops_pos)
         {
-            Logger::get_instance()->Log(NULL, NULL, Logger::Warning,
-                    "Loaded op list " + name + "has wrong type; ignoring");
-            v = Value(Value::array);
+            const Value & entry = clostops.Array()[expiry_lostops_pos];
+
+            if (!Removed()(entry) && expired(entry, currenttime))
+                expire_lost_entry(lostops.Array()[expiry_lostops_pos], currenttime);
         }
+
+        if (expiry_dno_pos < n_dno || expiry_lostops_pos < n_lostops)
+            return true;
+
+        do_removals(dno, &expiry_dno_pos);
+        do_removals(lostops, &expiry_lostops_pos);
+        return false;
+    }
+
+    void load_list(Value & v, std::string name, RecordSchema::ptr schema)
+    {
+        // Stays empty if there's nothing stored, or it can't be read.
+        v = Value(Value::array);
+
+        StorageManager::get_instance()->LoadAsync(name,
+            [&v, name, schema] (const Value & loaded) {
+                if (loaded.Type() != Value::array)
+                {
+                    Logger::get_instance()->Log(NULL, NULL, Logger::Warning,
+                            "Loaded op list " + name + " has wrong type; ignoring");
+                    return;
+                }
+
+                v = loaded;
+                for (ValueArray::iterator it = v.begin(); it != v.end(); ++it)
+                    if (it->Type() == Value::kvarray)
+                        *it = schema->make(*it);
+            },
+            [] (const std::string &) { });
     }
 
     void load_lists()
     {
-        load_list(dno, "donotop");
-        load_list(old, "expireddonotop");
-        load_list(lostops, "lostops");
+        load_list(dno, "donotop", entry_schema());
+        load_list(old, "expireddonotop", entry_schema());
+        load_list(lostops, "lostops", lost_entry_schema());
     }
 
     std::string build_reop_mask (Client::ptr c)
@@ -553,22 +632,23 @@ struct opbot : CommandHandlerBase<opbot>, Module
         if (m->source.destination != channelname)
             return;
 
-        for (ValueArray::iterator it = lostops.begin(); it != lostops.end(); ++it)
+        const Value &entries = lostops;
+        for (size_t i = 0; i < entries.Array().size(); ++i)
         {
-            if (mask_match((*it)["mask"], m->source.raw))
+            if (mask_match(entries[i]["mask"], m->source.raw))
             {
                 Client::ptr c = m->bot->find_client(m->source.name);
                 if (c)
                 {
                     std::weak_ptr<Client> w(c);
-                    Logger::get_instance()->Log(m->bot, NULL, Logger::Debug, "*** Matched lost op for " + m->source.raw + "(" + (*it)["mask"] + ")");
-                    Logger::get_instance()->Log(m->bot, NULL, Logger::Debug, "*** Queueing reop for " + m->source.name);
+                    Logger::get_instance()->Log(m->bot, NULL, Logger::Debug, [&] { return "*** Matched lost op for " + m->source.raw + "(" + entries[i]["mask"] + ")"; });
+                    Logger::get_instance()->Log(m->bot, NULL, Logger::Debug, [&] { return "*** Queueing reop for " + m->source.name; });
                     add_event(time(NULL)+5, std::bind(reop, m->bot, w, channelname));
-                    (*it)["removed"]=1;
+                    lostops[i]["removed"]=1;
                 }
             }
         }
-        do_removals(lostops);
+        do_removals(lostops, &expiry_lostops_pos);
     }
 
     void irc_nick(const Message *m)
@@ -583,18 +663,19 @@ struct opbot : CommandHandlerBase<opbot>, Module
         if (m->source.name == m->bot->nick())
             return;
 
-        for (ValueArray::iterator it = lostops.begin(); it != lostops.end(); ++it)
+        const Value &entries = lostops;
+        for (size_t i = 0; i < entries.Array().size(); ++i)
         {
-            if (mask_match((*it)["mask"], m->source.client->nuh()))
+            if (mask_match(entries[i]["mask"], m->source.client->nuh()))
             {
                 std::weak_ptr<Client> w(m->source.client);
-                Logger::get_instance()->Log(m->bot, NULL, Logger::Debug, "*** Matched lost op for " + m->source.raw + "(" + (*it)["mask"] + ")");
-                Logger::get_instance()->Log(m->bot, NULL, Logger::Debug, "*** Queueing reop for " + m->source.destination );
+                Logger::get_instance()->Log(m->bot, NULL, Logger::Debug, [&] { return "*** Matched lost op for " + m->source.raw + "(" + entries[i]["mask"] + ")"; });
+                Logger::get_instance()->Log(m->bot, NULL, Logger::Debug, [&] { return "*** Queueing reop for " + m->source.destination; });
                 add_event(time(NULL)+5, std::bind(reop, m->bot, w, channelname));
-                (*it)["removed"]=1;
+                lostops[i]["removed"]=1;
             }
         }
-        do_removals(lostops);
+        do_removals(lostops, &expiry_lostops_pos);
     }
 
     void irc_mode(const Message *m)
@@ -636,7 +717,7 @@ struct opbot : CommandHandlerBase<opbot>, Module
 					std::string dnotime = m->bot->get_setting_with_default("opbot_abuse_dno_time", "30d");
 					do_add_internal(m->bot, banmask, dnotime, "Deopping the bot");
 
-					Logger::get_instance()->Log(m->bot, m->source.client, Logger::Debug, "*** Akicking " + m->source.name + " (bot deopped)");
+					Logger::get_instance()->Log(m->bot, m->source.client, Logger::Debug, [&] { return "*** Akicking " + m->source.name + " (bot deopped)"; });
 				} else {
 					std::string opcommand = "PRIVMSG ChanServ :OP " + channelname;
 					m->bot->send(opcommand);
@@ -672,7 +753,7 @@ struct opbot : CommandHandlerBase<opbot>, Module
 					std::string dnotime = m->bot->get_setting_with_default("opbot_abuse_dno_time", "30d");
 					do_add_internal(m->bot, banmask, dnotime, "Banning the bot");
 
-					Logger::get_instance()->Log(m->bot, m->source.client, Logger::Debug, "*** Akicking " + m->source.name + " (bot banned)");
+					Logger::get_instance()->Log(m->bot, m->source.client, Logger::Debug, [&] { return "*** Akicking " + m->source.name + " (bot banned)"; });
 				}
 
 				std::string unbancommand = "PRIVMSG ChanServ :UNBAN " + channelname;
@@ -728,7 +809,7 @@ struct opbot : CommandHandlerBase<opbot>, Module
 						std::string dnotime = m->bot->get_setting_with_default("opbot_abuse_dno_time", "30d");
 						do_add_internal(m->bot, banmask, dnotime, "Kicking the bot");
 
-						Logger::get_instance()->Log(m->bot, m->source.client, Logger::Debug, "*** Akicking " + m->source.name + " (bot kicked)");
+						Logger::get_instance()->Log(m->bot, m->source.client, Logger::Debug, [&] { return "*** Akicking " + m->source.name + " (bot kicked)"; });
 					}
 
 					std::string unbancommand = "PRIVMSG ChanServ :UNBAN " + channelname; // in case of...
@@ -740,7 +821,7 @@ struct opbot : CommandHandlerBase<opbot>, Module
 					return;
 				} else if (m->source.name == "ChanServ") {
 					// user was ejected from the channel by ChanServ (akick?)
-					Logger::get_instance()->Log(m->bot, NULL, Logger::Debug, "*** " + m->args[0]  + "was akicked from channel - will not reop");
+					Logger::get_instance()->Log(m->bot, NULL, Logger::Debug, [&] { return "*** " + m->args[0]  + "was akicked from channel - will not reop"; });
 					return;
 				}
             } else if (m->command == "QUIT") {
@@ -750,7 +831,7 @@ struct opbot : CommandHandlerBase<opbot>, Module
                     if (q == "Killed" ||  q == "K-Lined" ||  q == "Changing" ||  q == "*.net")
                     {
                         // Abnormal quit - ignore
-                        Logger::get_instance()->Log(m->bot, NULL, Logger::Debug, "*** " + m->source.client->nick()  + "left network abnormally - will not reop");
+                        Logger::get_instance()->Log(m->bot, NULL, Logger::Debug, [&] { return "*** " + m->source.client->nick()  + "left network abnormally - will not reop"; });
                         return;
                     }
                 }
@@ -773,16 +854,17 @@ struct opbot : CommandHandlerBase<opbot>, Module
             if (!mask.empty())
             {
                 // check we don't already have this mask
-                for (ValueArray::iterator it = lostops.begin(); it != lostops.end(); ++it)
+                const Value &entries = lostops;
+                for (ValueArray::const_iterator it = entries.begin(); it != entries.end(); ++it)
                 {
                     if ((*it)["mask"] == mask)
                     {
-                        Logger::get_instance()->Log(m->bot, NULL, Logger::Debug, "*** " + mask + " is already on lostops list, skipping");
+                        Logger::get_instance()->Log(m->bot, NULL, Logger::Debug, [&] { return "*** " + mask + " is already on lostops list, skipping"; });
                         return;
                     }
                 }
                 lostops.push_back(lostopentry(m->bot->name(), mask, get_reop_expiry(m->bot)+time(NULL)));
-                Logger::get_instance()->Log(m->bot, NULL, Logger::Debug, "*** " + nick + "(" + mask + ")" + " left " + channelname + " with op");
+                Logger::get_instance()->Log(m->bot, NULL, Logger::Debug, [&] { return "*** " + nick + "(" + mask + ")" + " left " + channelname + " with op"; });
             }
         }
     }
@@ -803,16 +885,16 @@ struct opbot : CommandHandlerBase<opbot>, Module
 
         if (mem->has_mode('o'))
         {
-            Logger::get_instance()->Log(bot, NULL, Logger::Debug, "**** " + c->nick() + " is alreadly opped on " + channel +", skipping");
+            Logger::get_instance()->Log(bot, NULL, Logger::Debug, [&] { return "**** " + c->nick() + " is alreadly opped on " + channel +", skipping"; });
         } else {
-            Logger::get_instance()->Log(bot, NULL, Logger::Debug, "*** reopping " + c->nick() + " on "+ channel);
+            Logger::get_instance()->Log(bot, NULL, Logger::Debug, [&] { return "*** reopping " + c->nick() + " on "+ channel; });
             Logger::get_instance()->Log(bot, NULL, Logger::Admin, "*** reopping " + c->nick() + " on "+ channel);
             bot->send("MODE " + channel + " +o " + c->nick());
         }
     }
 
     CommandHolder add, remove, list, info, check, op, clear, change, match_client, shutdown, join, part, kick, quit, nick, mode;
-    EventHolder check_event;
+    EventHolder check_event, expiry_task;
     HelpTopicHolder opbothelp, ophelp, checkhelp, matchhelp, addhelp, removehelp, edithelp;
     HelpIndexHolder index;
 
@@ -820,6 +902,7 @@ struct opbot : CommandHandlerBase<opbot>, Module
         : dno(GlobalSettingsManager::get_instance()->get("opbot:donotop")),
           old(GlobalSettingsManager::get_instance()->get("opbot:expireddonotop")),
           lostops(GlobalSettingsManager::get_instance()->get("opbot:lostops")),
+          expiry_dno_pos(0), expiry_lostops_pos(0),
           opbothelp("opbot", "opadmin", help_opbot),
           ophelp("op", "opadmin", help_op),
           checkhelp("op_check", "opadmin", help_check),
@@ -851,7 +934,7 @@ struct opbot : CommandHandlerBase<opbot>, Module
 
 		mode = add_handler(filter_command_type("mode_change", sourceinfo::Internal),&opbot::irc_mode, true, Message::first);
 
-        check_event = add_recurring_event(60, &opbot::check_expiry);
+        check_event = add_recurring_event(60, &opbot::check_expiry, 15);
 
         StorageManager::get_instance()->auto_save(&dno, "donotop");
         StorageManager::get_instance()->auto_save(&old, "expireddonotop");
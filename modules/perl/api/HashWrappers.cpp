@@ -71,7 +71,10 @@ SV* BotSettingsHash::FETCH(pTHX_ char *name)
 {
     try
     {
+        // Arrays are handed over as a snapshot; scalars are copied out directly.
         Value v = _bot->get_setting(name);
+        if (v.Type() == Value::array || v.Type() == Value::kvarray)
+            return sv_from_value(aTHX_ new Value(std::move(v)), true);
         return sv_from_value(aTHX_ &v);
     }
     catch (NotFoundError & e)
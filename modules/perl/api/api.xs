@@ -58,6 +58,27 @@ Bot::name()
 Capabilities *
 Bot::capabilities()
 
+void
+Bot::clients_by_host(const char *host)
+PPCODE:
+    Bot::ClientRange r = THIS->find_clients_by_host(host);
+    for (Bot::ClientIterator it = r.first; it != r.second; ++it)
+        XPUSHs(sv_from(aTHX_ it->get()));
+
+void
+Bot::clients_by_account(const char *account)
+PPCODE:
+    Bot::ClientRange r = THIS->find_clients_by_account(account);
+    for (Bot::ClientIterator it = r.first; it != r.second; ++it)
+        XPUSHs(sv_from(aTHX_ it->get()));
+
+void
+Bot::clients_by_userhost(const char *userhost)
+PPCODE:
+    Bot::ClientRange r = THIS->find_clients_by_userhost(userhost);
+    for (Bot::ClientIterator it = r.first; it != r.second; ++it)
+        XPUSHs(sv_from(aTHX_ it->get()));
+
 
 INCLUDE: clients.xs
 INCLUDE: helpers.xs
@@ -15,6 +15,9 @@ Client::nuh()
 string
 Client::account()
 
+unsigned int
+Client::id()
+
 int
 Client::has_privilege(...)
 CODE:
@@ -57,7 +60,7 @@ OUTPUT:
 string
 Membership::modes()
 CODE:
-    RETVAL = THIS->modes;
+    RETVAL = THIS->modes();
 OUTPUT:
     RETVAL
 
@@ -34,12 +34,16 @@ OUTPUT:
     RETVAL
 
 PerlHolder *
-add_recurring_event(int time, SV *func)
+add_recurring_event(int time, SV *func, ...)
 CODE:
+    int slack = 0;
+    if (items > 2)
+        slack = SvIV(ST(2));
     EventManager::id id = EventManager::get_instance()->add_recurring_event(
                                 time,
                                 std::bind(call_perl<PerlContext::Void, const char *, SV*>,
-                                            aTHX_ "Eir::Init::call_wrapper", func));
+                                            aTHX_ "Eir::Init::call_wrapper", func),
+                                slack);
     RETVAL = new PerlEventHolder(aTHX_ id, func);
 OUTPUT:
     RETVAL
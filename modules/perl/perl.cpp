@@ -104,7 +104,16 @@ struct PerlModule : CommandHandlerBase<PerlModule>, Module
             dlclose(libperl_handle);
     }
 
+    // Perl doesn't track its own heap size; count live SVs and their heads as a lower bound.
+    MemoryUsage perl_memory()
+    {
+        if (!my_perl)
+            return MemoryUsage();
+        return MemoryUsage(PL_sv_count, PL_sv_count * sizeof(SV));
+    }
+
     CommandHolder load_id, unload_id, exec_id;
+    MemoryReporterHolder memory_id;
 
     PerlModule()
         : my_perl(0)
@@ -116,6 +125,8 @@ struct PerlModule : CommandHandlerBase<PerlModule>, Module
                 &PerlModule::do_script_unload);
         exec_id = add_handler(filter_command_privilege("execscript", "admin"),
                 &PerlModule::do_script_exec);
+        memory_id = MemoryAccounting::get_instance()->add_reporter("perl",
+                std::bind(&PerlModule::perl_memory, this));
     }
 
     ~PerlModule()
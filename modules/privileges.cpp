@@ -3,6 +3,8 @@
 #include "match.h"
 
 #include <algorithm>
+#include <vector>
+#include <set>
 
 using namespace eir;
 
@@ -11,9 +13,15 @@ struct PrivilegeHandler : CommandHandlerBase<PrivilegeHandler>, Module
     Value & priv_entries() { return GlobalSettingsManager::get_instance()->get("privileges"); }
     Value & priv_types() { return GlobalSettingsManager::get_instance()->get("privilege_types"); }
 
+    RecordSchema::ptr entry_schema()
+    {
+        static RecordSchema::ptr schema = RecordSchema::get({"type", "match", "channel", "priv", "is_config"});
+        return schema;
+    }
+
     Value make_priv_entry(std::string type, std::string match, std::string channel, std::string priv, bool config = false)
     {
-        Value v(Value::kvarray);
+        Value v = entry_schema()->make();
         v["type"] = type;
         v["match"] = match;
         v["channel"] = channel;
@@ -117,7 +125,7 @@ struct PrivilegeHandler : CommandHandlerBase<PrivilegeHandler>, Module
                 ++it;
         }
 
-        recalculate_privileges(m);
+        recalculate_privileges_now(m);
     }
 
     void list_privs(const Message *m)
@@ -131,7 +139,8 @@ struct PrivilegeHandler : CommandHandlerBase<PrivilegeHandler>, Module
 
         std::map<std::string, std::string> response, c_response;
 
-        for (auto it = priv_entries().begin(); it != priv_entries().end(); ++it)
+        const Value &entries = priv_entries();
+        for (ValueArray::const_iterator it = entries.begin(); it != entries.end(); ++it)
         {
             if (!channel.empty() && (*it)["channel"] != channel)
                 continue;
@@ -167,10 +176,67 @@ struct PrivilegeHandler : CommandHandlerBase<PrivilegeHandler>, Module
         set_client_privileges(m->bot, m->source.client);
     }
 
+    // Recalculating privileges for every client on a large network is slow, so
+    // when privileges have only been added it's done in chunks from an idle task.
+    // Requests that arrive while a pass is running are remembered, and another
+    // pass is started once it finishes, so that later changes are never missed.
+    // Anything that can take privileges away recalculates at once instead, so
+    // that they don't linger while the bot is busy. Bots are remembered by name,
+    // since one may be shut down before the pass reaches it.
+    enum { recalc_chunk = 64 };
+    std::set<std::string> recalc_requested;
+    std::vector<std::pair<std::string, std::weak_ptr<Client> > > recalc_queue;
+    EventHolder recalc_task;
+
     void recalculate_privileges(const Message *m)
     {
-        for (auto it = m->bot->begin_clients(); it != m->bot->end_clients(); ++it)
-            set_client_privileges(m->bot, *it);
+        recalc_requested.insert(m->bot->name());
+        recalc_task = add_idle_task(&PrivilegeHandler::recalculate_step, 5);
+    }
+
+    void recalculate_privileges_now(const Message *m)
+    {
+        Bot *b = m->bot;
+
+        for (auto it = b->begin_clients(); it != b->end_clients(); ++it)
+            set_client_privileges(b, *it);
+
+        // Any pass already waiting for this bot has nothing left to do.
+        const std::string & name = b->name();
+        recalc_requested.erase(name);
+        recalc_queue.erase(std::remove_if(recalc_queue.begin(), recalc_queue.end(),
+                    [&name] (const std::pair<std::string, std::weak_ptr<Client> > & p) { return p.first == name; }),
+                recalc_queue.end());
+    }
+
+    bool recalculate_step()
+    {
+        if (recalc_queue.empty())
+        {
+            for (auto n = recalc_requested.begin(); n != recalc_requested.end(); ++n)
+            {
+                Bot *b = BotManager::get_instance()->find(*n);
+                if (!b)
+                    continue;
+                for (auto it = b->begin_clients(); it != b->end_clients(); ++it)
+                    recalc_queue.push_back(std::make_pair(*n, std::weak_ptr<Client>(*it)));
+            }
+            recalc_requested.clear();
+        }
+
+        for (int i = 0; i < recalc_chunk && !recalc_queue.empty(); ++i)
+        {
+            Client::ptr c = recalc_queue.back().second.lock();
+            Bot *b = c ? BotManager::get_instance()->find(recalc_queue.back().first) : NULL;
+            recalc_queue.pop_back();
+
+            // Clients, or whole bots, that have gone away since the pass started
+            // are simply skipped.
+            if (b)
+                set_client_privileges(b, c);
+        }
+
+        return !recalc_queue.empty() || !recalc_requested.empty();
     }
 
     void clear_conf_privileges(const Message *)
@@ -181,16 +247,24 @@ struct PrivilegeHandler : CommandHandlerBase<PrivilegeHandler>, Module
         priv_entries() = new_privs;
     }
 
-    CommandHolder add_id, add2_id, remove_id, client_id, recalc_id, clear_id, list_id;
+    CommandHolder add_id, add2_id, remove_id, client_id, nick_id, host_id, account_id, recalc_id, clear_id, list_id;
 
     PrivilegeHandler()
     {
         client_id = add_handler(filter_command_type("new_client",sourceinfo::Internal),
                                 &PrivilegeHandler::set_client_privileges_from);
+        // A client's privileges depend on its nick, user, host and account.
+        nick_id = add_handler(filter_command_type("nick_changed",sourceinfo::Internal),
+                                &PrivilegeHandler::set_client_privileges_from);
+        host_id = add_handler(filter_command_type("host_changed",sourceinfo::Internal),
+                                &PrivilegeHandler::set_client_privileges_from);
+        account_id = add_handler(filter_command_type("account_changed",sourceinfo::Internal),
+                                &PrivilegeHandler::set_client_privileges_from);
         add_id = add_handler(filter_command_type("privilege", sourceinfo::ConfigFile),
                                 &PrivilegeHandler::add_privilege_entry);
+        // This comes after a rehash, which may have removed config privileges.
         recalc_id = add_handler(filter_command_type("recalculate_privileges", sourceinfo::Internal),
-                                &PrivilegeHandler::recalculate_privileges);
+                                &PrivilegeHandler::recalculate_privileges_now);
         clear_id = add_handler(filter_command_type("clear_lists", sourceinfo::Internal),
                                 &PrivilegeHandler::clear_conf_privileges);
         // These do their own privilege checking. The lack of privilege filter is intentional.
@@ -202,21 +276,28 @@ struct PrivilegeHandler : CommandHandlerBase<PrivilegeHandler>, Module
                                 &PrivilegeHandler::list_privs);
 
         // Load stored privileges. Maintain upgrade path from previous versions.
-        try
-        {
-            Value loaded_privs = StorageManager::get_instance()->Load("privileges");
-            if (loaded_privs.Type() == Value::kvarray)
-                priv_entries() = loaded_privs["global"];
-            else
-                priv_entries() = loaded_privs;
-        }
-        catch (std::exception &)
-        {
-            priv_entries() = Value(Value::array);
-        }
+        // Config file entries may be added before it arrives, and are kept.
+        priv_entries() = Value(Value::array);
+
+        StorageManager::get_instance()->LoadAsync("privileges",
+            [this] (const Value & loaded) {
+                Value stored = loaded.Type() == Value::kvarray ? loaded["global"] : loaded;
+                if (stored.Type() != Value::array)
+                    return;
+
+                Value merged(Value::array);
+                for (ValueArray::iterator it = stored.begin(); it != stored.end(); ++it)
+                {
+                    if (it->Type() != Value::kvarray || (*it)["is_config"])
+                        continue;
+                    merged.push_back(entry_schema()->make(*it));
+                }
+                for (ValueArray::iterator it = priv_entries().begin(); it != priv_entries().end(); ++it)
+                    merged.push_back(*it);
 
-        // Strip out old config file entries.
-        clear_conf_privileges(0);
+                priv_entries() = merged;
+            },
+            [] (const std::string &) { });
 
         // And set privs to auto-save
         StorageManager::get_instance()->auto_save(&priv_entries(), "privileges");
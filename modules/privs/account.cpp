@@ -13,7 +13,8 @@ struct AccountPrivilege : CommandHandlerBase<AccountPrivilege>, Module
 
     void calculate_account_privileges(const Message *m)
     {
-        for (auto it = priv_entries().begin(); it != priv_entries().end(); ++it)
+        const Value &entries = priv_entries();
+        for (ValueArray::const_iterator it = entries.begin(); it != entries.end(); ++it)
         {
             if ((*it)["type"] == "account" &&
                 (*it)["match"] == m->source.client->account())
@@ -0,0 +1,92 @@
+#include "eir.h"
+#include "handler.h"
+#include "help.h"
+#include "memory.h"
+
+#include <paludis/util/stringify.hh>
+
+#include <cstdio>
+
+using namespace eir;
+
+namespace
+{
+    const char *help_stats =
+        "stats memory -- Shows approximate memory used by tracked clients, channels and\n"
+        "memberships, handler tables, send queues, global settings and scripting.";
+
+    std::string format_bytes(unsigned long bytes)
+    {
+        char buf[32];
+        if (bytes >= 1024 * 1024)
+            snprintf(buf, sizeof buf, "%.1fM", bytes / (1024.0 * 1024.0));
+        else if (bytes >= 1024)
+            snprintf(buf, sizeof buf, "%.1fK", bytes / 1024.0);
+        else
+            snprintf(buf, sizeof buf, "%luB", bytes);
+        return buf;
+    }
+}
+
+struct StatsModule : CommandHandlerBase<StatsModule>, Module
+{
+    void stats_memory(const Message *m)
+    {
+        MemoryAccounting::Report report = MemoryAccounting::get_instance()->report();
+        MemoryUsage total;
+
+        for (MemoryAccounting::Report::iterator it = report.begin(); it != report.end(); ++it)
+        {
+            if (it->second.objects == 0 && it->second.bytes == 0)
+                continue;
+            m->source.reply(it->first + ": " + paludis::stringify(it->second.objects) +
+                            " objects, " + format_bytes(it->second.bytes));
+            total += it->second;
+        }
+
+        m->source.reply("Total: " + paludis::stringify(total.objects) + " objects, " +
+                        format_bytes(total.bytes) + " (approximate)");
+    }
+
+    void stats(const Message *m)
+    {
+        if (m->args.empty() || m->args[0] != "memory")
+        {
+            m->source.error("Usage: stats memory");
+            return;
+        }
+
+        stats_memory(m);
+    }
+
+    void log_memory()
+    {
+        MemoryAccounting::Report report = MemoryAccounting::get_instance()->report();
+        MemoryUsage total;
+        std::string line;
+
+        for (MemoryAccounting::Report::iterator it = report.begin(); it != report.end(); ++it)
+        {
+            if (it->second.bytes == 0)
+                continue;
+            line += "; " + it->first + " " + format_bytes(it->second.bytes);
+            total += it->second;
+        }
+
+        Logger::get_instance()->Log(NULL, NULL, Logger::Info,
+                "Memory usage: " + format_bytes(total.bytes) + " total" + line);
+    }
+
+    CommandHolder stats_id;
+    EventHolder log_event;
+    HelpTopicHolder statshelp;
+
+    StatsModule()
+        : statshelp("stats", "admin", help_stats)
+    {
+        stats_id = add_handler(filter_command_privilege("stats", "admin"), &StatsModule::stats);
+        log_event = add_recurring_event(3600, &StatsModule::log_memory, 300);
+    }
+};
+
+MODULE_CLASS(StatsModule)
@@ -0,0 +1,69 @@
+#include "eir.h"
+#include "storage.h"
+#include "handler.h"
+#include "help.h"
+#include "value_binary.h"
+
+using namespace eir;
+
+namespace
+{
+    const char *help_convert =
+        "storage_convert <from> <to> -- Loads a stored value and saves it again somewhere else, for example\n"
+        "\002storage_convert json:donotop binary:donotop\002 to move a list from the json to the binary format.";
+}
+
+struct BinaryStorage : CommandHandlerBase<BinaryStorage>, Module, StorageBackend
+{
+    void Save(const Value & v, std::string target)
+    {
+        write_file_atomically(DATADIR "/" + target, binary::encode(v));
+    }
+
+    Value Load(std::string source)
+    {
+        return binary::decode(read_whole_file(DATADIR "/" + source));
+    }
+
+    void convert(const Message *m)
+    {
+        if (m->args.size() < 2)
+        {
+            m->source.error("Usage: storage_convert <from> <to>");
+            return;
+        }
+
+        try
+        {
+            StorageManager *sm = StorageManager::get_instance();
+            sm->Save(sm->Load(m->args[0]), m->args[1]);
+        }
+        catch (StorageError &e)
+        {
+            m->source.error(e.message());
+            return;
+        }
+        catch (IOError &e)
+        {
+            m->source.error(e.message());
+            return;
+        }
+
+        m->source.reply("Converted " + m->args[0] + " to " + m->args[1]);
+    }
+
+    StorageBackendHolder backendid;
+    CommandHolder convert_id, convert_conf_id;
+    HelpTopicHolder converthelp;
+
+    BinaryStorage()
+        : converthelp("storage_convert", "admin", help_convert)
+    {
+        backendid = StorageManager::get_instance()->register_backend("binary", this);
+        convert_id = add_handler(filter_command_privilege("storage_convert", "admin"), &BinaryStorage::convert);
+        convert_conf_id = add_handler(filter_command_type("storage_convert", sourceinfo::ConfigFile),
+                                      &BinaryStorage::convert);
+    }
+};
+
+MODULE_CLASS(BinaryStorage)
@@ -0,0 +1,485 @@
+#include "eir.h"
+#include "storage.h"
+#include "value_binary.h"
+#include "handler.h"
+
+#include <paludis/util/stringify.hh>
+
+#include <map>
+#include <mutex>
+#include <random>
+#include <algorithm>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+
+using namespace eir;
+
+/*
+ * Each target is kept as a checkpoint, holding the whole value, plus a journal
+ * of changes made since. A save works out what changed since the last save and
+ * appends just that to the journal; once the journal grows bigger than the
+ * checkpoint, the next save writes a new checkpoint and starts the journal
+ * again.
+ *
+ * Both files are made of values in the binary encoding. The checkpoint is a
+ * kvarray of "id" and "value". The journal is a series of frames, each a
+ * four-byte little-endian length followed by one encoded record. The first
+ * record names the checkpoint id the journal applies to, so that a journal
+ * left behind by a crash part-way through checkpointing is ignored rather
+ * than replayed over the wrong base. Every record carries its own checksum, so
+ * a torn write at the end of the journal is detected and dropped.
+ *
+ * A record is an array of [op, path, args...], where the path is an array of
+ * kvarray keys and array indices leading from the root to the value changed.
+ */
+
+namespace
+{
+    enum Op
+    {
+        op_base,            // [op_base, id]
+        op_set,             // [op_set, path, value]
+        op_erase,           // [op_erase, path] -- the last path element is a key
+        op_splice           // [op_splice, path, index, delete_count, [values...]]
+    };
+
+    // Once the journal is this much bigger than the checkpoint, checkpoint again.
+    const double checkpoint_ratio = 1.0;
+    // ...but don't bother for anything smaller than this.
+    const std::size_t min_journal_size = 64 * 1024;
+    // How far ahead to look for matching entries when two arrays differ.
+    const std::size_t resync_distance = 16;
+
+    std::string frame(const Value & record)
+    {
+        std::string data = binary::encode(record);
+        std::string ret;
+        for (int i = 0; i < 4; ++i)
+            ret += char((data.size() >> (8 * i)) & 0xFF);
+        return ret + data;
+    }
+
+    /*
+     * Unchanged parts of a value still share their contents with the previous
+     * save, so most of the comparison is a pointer check.
+     */
+    struct Differ
+    {
+        // A run of old entries replaced by a run of new ones.
+        struct Hunk
+        {
+            std::size_t a_begin, a_count, b_begin, b_count;
+        };
+
+        std::string out;
+
+        void emit(Value record)
+        {
+            out += frame(record);
+        }
+
+        static Value child(const Value & path, Value component)
+        {
+            Value ret = path;
+            ret.push_back(component);
+            return ret;
+        }
+
+        void set(const Value & path, const Value & v)
+        {
+            Value record(Value::array);
+            record.push_back(op_set);
+            record.push_back(path);
+            record.push_back(v);
+            emit(record);
+        }
+
+        void splice(const Value & path, std::size_t index, std::size_t count,
+                    const ValueArray & from, std::size_t begin, std::size_t end)
+        {
+            Value record(Value::array), values(Value::array);
+            for (std::size_t i = begin; i < end; ++i)
+                values.push_back(from[i]);
+            record.push_back(op_splice);
+            record.push_back(path);
+            record.push_back(int(index));
+            record.push_back(int(count));
+            record.push_back(values);
+            emit(record);
+        }
+
+        void diff(const Value & a, const Value & b, const Value & path)
+        {
+            if (a.shares_contents(b))
+                return;
+
+            if (a.Type() != b.Type())
+                set(path, b);
+            else if (a.Type() == Value::array)
+                diff_array(a.Array(), b.Array(), path);
+            else if (a.Type() == Value::kvarray)
+                diff_kv(a.KV(), b.KV(), path);
+            else if (!a.equals(b))
+                set(path, b);
+        }
+
+        void diff_kv(const KeyValueArray & a, const KeyValueArray & b, const Value & path)
+        {
+            for (KeyValueArray::const_iterator it = b.begin(); it != b.end(); ++it)
+            {
+                KeyValueArray::const_iterator old = a.find(it->first);
+                if (old == a.end())
+                    set(child(path, it->first), it->second);
+                else
+                    diff(old->second, it->second, child(path, it->first));
+            }
+
+            for (KeyValueArray::const_iterator it = a.begin(); it != a.end(); ++it)
+            {
+                if (b.find(it->first) == b.end())
+                {
+                    Value record(Value::array);
+                    record.push_back(op_erase);
+                    record.push_back(child(path, it->first));
+                    emit(record);
+                }
+            }
+        }
+
+        void diff_array(const ValueArray & a, const ValueArray & b, const Value & path)
+        {
+            std::size_t na = a.size(), nb = b.size(), prefix = 0, suffix = 0;
+
+            while (prefix < na && prefix < nb && a[prefix].equals(b[prefix]))
+                ++prefix;
+            while (suffix < na - prefix && suffix < nb - prefix && a[na - 1 - suffix].equals(b[nb - 1 - suffix]))
+                ++suffix;
+
+            // Walk the two middles together. Where they differ, look a short way
+            // ahead for the nearest point where they match up again, so that the
+            // usual case of a few entries added, removed or changed is recorded as
+            // just those; if nothing matches nearby, the rest is one hunk.
+            std::vector<Hunk> hunks;
+            std::size_t i = prefix, j = prefix, ea = na - suffix, eb = nb - suffix;
+
+            while (i < ea && j < eb)
+            {
+                if (a[i].equals(b[j]))
+                {
+                    ++i, ++j;
+                    continue;
+                }
+
+                Hunk h = { i, ea - i, j, eb - j };
+                bool found = false;
+                for (std::size_t d = 1; d <= resync_distance && !found; ++d)
+                    for (std::size_t x = 0; x <= d && !found; ++x)
+                        if (i + x < ea && j + d - x < eb && a[i + x].equals(b[j + d - x]))
+                        {
+                            h.a_count = x;
+                            h.b_count = d - x;
+                            found = true;
+                        }
+
+                hunks.push_back(h);
+                i += h.a_count;
+                j += h.b_count;
+            }
+
+            if (i < ea || j < eb)
+            {
+                Hunk h = { i, ea - i, j, eb - j };
+                hunks.push_back(h);
+            }
+
+            // Apply from the back, so that each hunk's position in the old array
+            // is still right when it's replayed.
+            for (std::vector<Hunk>::reverse_iterator h = hunks.rbegin(); h != hunks.rend(); ++h)
+            {
+                if (h->a_count == h->b_count)
+                    for (std::size_t k = 0; k < h->a_count; ++k)
+                        diff(a[h->a_begin + k], b[h->b_begin + k], child(path, int(h->a_begin + k)));
+                else
+                    splice(path, h->a_begin, h->a_count, b, h->b_begin, h->b_begin + h->b_count);
+            }
+        }
+    };
+
+    void journal_error(const std::string & what)
+    {
+        throw IOError("Corrupt journal record: " + what);
+    }
+
+    Value & follow(Value & root, const ValueArray & path, std::size_t length)
+    {
+        Value *v = &root;
+        for (std::size_t i = 0; i < length; ++i)
+        {
+            if (path[i].Type() == Value::string)
+                v = &(*v)[path[i].String()];
+            else if (path[i].Type() == Value::integer && v->Type() == Value::array &&
+                        path[i].Int() >= 0 && std::size_t(path[i].Int()) < v->Array().size())
+                v = &v->Array()[path[i].Int()];
+            else
+                journal_error("bad path");
+        }
+        return *v;
+    }
+
+    void apply(Value & root, const Value & record)
+    {
+        const ValueArray &r = record.Array();
+        if (r.size() < 2 || r[1].Type() != Value::array)
+            journal_error("malformed");
+
+        const ValueArray &path = r[1].Array();
+
+        switch (r[0].Int())
+        {
+            case op_set:
+                if (r.size() != 3)
+                    journal_error("malformed set");
+                follow(root, path, path.size()) = r[2];
+                break;
+
+            case op_erase:
+                {
+                    if (r.size() != 2 || path.empty() || path[path.size() - 1].Type() != Value::string)
+                        journal_error("malformed erase");
+                    Value &parent = follow(root, path, path.size() - 1);
+                    if (parent.Type() != Value::kvarray)
+                        journal_error("erase from a non-kvarray");
+                    parent.KV().erase(path[path.size() - 1].String());
+                    break;
+                }
+
+            case op_splice:
+                {
+                    if (r.size() != 5 || r[2].Type() != Value::integer || r[3].Type() != Value::integer ||
+                            r[4].Type() != Value::array)
+                        journal_error("malformed splice");
+                    Value &target = follow(root, path, path.size());
+                    if (target.Type() != Value::array)
+                        journal_error("splice into a non-array");
+
+                    ValueArray &array = target.Array();
+                    int index = r[2].Int(), count = r[3].Int();
+                    if (index < 0 || count < 0 || std::size_t(index) + count > array.size())
+                        journal_error("splice out of range");
+
+                    for (int i = 0; i < count; ++i)
+                        array.erase(index);
+                    const ValueArray &values = r[4].Array();
+                    for (std::size_t i = 0; i < values.size(); ++i)
+                        array.insert(index + i, values[i]);
+                    break;
+                }
+
+            default:
+                journal_error("unknown op " + paludis::stringify(r[0].Int()));
+        }
+    }
+
+    void append_file(const std::string & filename, const std::string & data)
+    {
+        int fd = open(filename.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+        if (fd < 0)
+            throw IOError("Couldn't open " + filename + ": " + strerror(errno));
+
+        const char *p = data.data();
+        std::size_t left = data.size();
+        int err = 0;
+
+        while (left > 0 && !err)
+        {
+            ssize_t n = write(fd, p, left);
+            if (n < 0 && errno != EINTR)
+                err = errno;
+            else if (n > 0)
+            {
+                p += n;
+                left -= n;
+            }
+        }
+
+        if (!err && fsync(fd) < 0)
+            err = errno;
+        close(fd);
+
+        if (err)
+            throw IOError("Error appending to " + filename + ": " + strerror(err));
+    }
+}
+
+struct JournalStorage : Module, StorageBackend
+{
+    // What we last saved to, or loaded from, each target.
+    struct Target
+    {
+        Value value;
+        int id;
+        std::size_t checkpoint_bytes, journal_bytes;
+        // Set when the journal ends in a torn record, which must not be appended to.
+        bool needs_checkpoint;
+    };
+
+    std::mutex lock;
+    std::map<std::string, Target> targets;
+    std::mt19937 random_ids;
+
+    void checkpoint(const Value & v, const std::string & target)
+    {
+        Target t;
+        t.value = v;
+        do
+            t.id = random_ids() & 0x7FFFFFFF;
+        while (targets.count(target) && targets[target].id == t.id);
+        t.needs_checkpoint = false;
+
+        Value cp(Value::kvarray);
+        cp["id"] = t.id;
+        cp["value"] = v;
+        std::string data = binary::encode(cp);
+        t.checkpoint_bytes = data.size();
+
+        Value base(Value::array);
+        base.push_back(op_base);
+        base.push_back(t.id);
+        std::string journal = frame(base);
+        t.journal_bytes = journal.size();
+
+        // The checkpoint goes first; until the new journal replaces the old one,
+        // the old one names the wrong id and won't be replayed over it.
+        write_file_atomically(DATADIR "/" + target, data);
+        write_file_atomically(DATADIR "/" + target + ".journal", journal);
+
+        targets[target] = t;
+    }
+
+    void Save(const Value & v, std::string target)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        std::map<std::string, Target>::iterator it = targets.find(target);
+        if (it == targets.end() || it->second.needs_checkpoint)
+        {
+            checkpoint(v, target);
+            return;
+        }
+
+        Target &t = it->second;
+
+        Differ d;
+        d.diff(t.value, v, Value(Value::array));
+
+        if (d.out.empty())
+        {
+            t.value = v;
+            return;
+        }
+
+        std::size_t limit = std::max(min_journal_size, std::size_t(t.checkpoint_bytes * checkpoint_ratio));
+        if (t.journal_bytes + d.out.size() > limit)
+        {
+            checkpoint(v, target);
+            return;
+        }
+
+        append_file(DATADIR "/" + target + ".journal", d.out);
+        t.journal_bytes += d.out.size();
+        t.value = v;
+    }
+
+    Value Load(std::string source)
+    {
+        std::string filename(DATADIR "/" + source), data = read_whole_file(filename);
+
+        Value cp = binary::decode(data);
+        if (cp.Type() != Value::kvarray || cp["id"].Type() != Value::integer)
+            throw IOError(filename + " isn't a journal checkpoint");
+
+        Target t;
+        t.value = cp["value"];
+        t.id = cp["id"].Int();
+        t.checkpoint_bytes = data.size();
+        t.journal_bytes = 0;
+        t.needs_checkpoint = false;
+
+        // Without a readable journal, the checkpoint is all there is.
+        std::string journal;
+        try
+        {
+            journal = read_whole_file(filename + ".journal");
+        }
+        catch (IOError &)
+        {
+            t.needs_checkpoint = true;
+        }
+
+        std::size_t pos = 0;
+        bool first = true;
+
+        while (!t.needs_checkpoint && pos < journal.size())
+        {
+            std::size_t len = 0;
+            Value record;
+
+            try
+            {
+                if (journal.size() - pos < 4)
+                    throw IOError("truncated length");
+                for (int i = 0; i < 4; ++i)
+                    len |= std::size_t(static_cast<unsigned char>(journal[pos + i])) << (8 * i);
+                if (journal.size() - pos - 4 < len)
+                    throw IOError("truncated record");
+                record = binary::decode(journal.substr(pos + 4, len));
+            }
+            catch (IOError & e)
+            {
+                // This may be on a loader thread, and the logger is the main thread's.
+                std::string warning = "Ignoring the end of " + filename +
+                        ".journal, which looks to have been cut short: " + e.message();
+                EventManager::get_instance()->post([warning] {
+                    Logger::get_instance()->Log(NULL, NULL, Logger::Warning, warning);
+                });
+                t.needs_checkpoint = true;
+                break;
+            }
+
+            if (first)
+            {
+                // A journal for some other checkpoint is left over from a crash
+                // while checkpointing, and the checkpoint already includes it.
+                if (record.Type() != Value::array || record.Array().size() != 2 ||
+                        record.Array()[0] != op_base || record.Array()[1] != t.id)
+                {
+                    t.needs_checkpoint = true;
+                    break;
+                }
+                first = false;
+            }
+            else
+                apply(t.value, record);
+
+            pos += 4 + len;
+            t.journal_bytes = pos;
+        }
+
+        std::lock_guard<std::mutex> guard(lock);
+        targets[source] = t;
+        return t.value;
+    }
+
+    StorageBackendHolder backendid;
+
+    JournalStorage()
+        : random_ids(std::random_device()())
+    {
+        backendid = StorageManager::get_instance()->register_backend("journal", this);
+    }
+};
+
+MODULE_CLASS(JournalStorage)
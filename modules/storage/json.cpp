@@ -1,137 +1,542 @@
 #include "eir.h"
 #include "storage.h"
+#include "handler.h"
 
-#include <functional>
-#include <fstream>
+#include <paludis/util/stringify.hh>
 
-#include "json/json.h"
+#include <atomic>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 using namespace eir;
 
 namespace
 {
-    Json::Value EirValueToJsonValue(const eir::Value &v)
+    /*
+     * Writes a Value out as JSON as it walks it, straight into the file's
+     * buffer. Pretty output is laid out much as Json::StyledWriter would.
+     */
+    class JsonWriter
     {
-        switch (v.Type())
-        {
-            case Value::empty:
-                return Json::Value::null;
+        private:
+            AtomicFileWriter &_out;
+            bool _pretty;
+
+            void newline(unsigned depth)
+            {
+                if (!_pretty)
+                    return;
+                _out.put('\n');
+                for (unsigned i = 0; i < depth * 3; ++i)
+                    _out.put(' ');
+            }
 
-            case Value::integer:
-                return Json::Value(v.Int());
+            void integer(int i)
+            {
+                char buf[16], *p = buf + sizeof buf;
+                unsigned u = i < 0 ? 0u - unsigned(i) : unsigned(i);
+                do
+                    *--p = '0' + u % 10;
+                while (u /= 10);
+                if (i < 0)
+                    *--p = '-';
+                _out.write(p, buf + sizeof buf - p);
+            }
 
-            case Value::string:
-                return Json::Value(v.String());
+            void string(const std::string & s)
+            {
+                static const char hex[] = "0123456789abcdef";
 
-            case Value::array:
+                _out.put('"');
+                std::string::size_type start = 0;
+                for (std::string::size_type i = 0; i < s.size(); ++i)
                 {
-                    Json::Value ret(Json::arrayValue);
-                    for (eir::ValueArray::const_iterator it = v.Array().begin(), it_e = v.Array().end();
-                            it != it_e; ++it)
+                    unsigned char c = s[i];
+                    if (c >= 0x20 && c != '"' && c != '\\')
+                        continue;
+
+                    _out.write(s.data() + start, i - start);
+                    start = i + 1;
+
+                    _out.put('\\');
+                    switch (c)
                     {
-                        ret.append(EirValueToJsonValue(*it));
+                        case '"':  _out.put('"'); break;
+                        case '\\': _out.put('\\'); break;
+                        case '\b': _out.put('b'); break;
+                        case '\f': _out.put('f'); break;
+                        case '\n': _out.put('n'); break;
+                        case '\r': _out.put('r'); break;
+                        case '\t': _out.put('t'); break;
+                        default:
+                            _out.write("u00", 3);
+                            _out.put(hex[c >> 4]);
+                            _out.put(hex[c & 0xF]);
                     }
-                    return ret;
                 }
-            case Value::kvarray:
+                _out.write(s.data() + start, s.size() - start);
+                _out.put('"');
+            }
+
+        public:
+            JsonWriter(AtomicFileWriter & out, bool pretty)
+                : _out(out), _pretty(pretty)
+            { }
+
+            void value(const Value & v, unsigned depth = 0)
+            {
+                switch (v.Type())
                 {
-                    Json::Value ret(Json::objectValue);
-                    for (eir::KeyValueArray::const_iterator it = v.KV().begin(), it_e = v.KV().end();
-                            it != it_e; ++it)
+                    case Value::empty:
+                        _out.write("null", 4);
+                        break;
+
+                    case Value::integer:
+                        integer(v.Int());
+                        break;
+
+                    case Value::string:
+                        string(v.String());
+                        break;
+
+                    case Value::array:
+                        {
+                            const ValueArray &a = v.Array();
+                            _out.put('[');
+                            for (std::size_t i = 0; i < a.size(); ++i)
+                            {
+                                if (i > 0)
+                                    _out.put(',');
+                                newline(depth + 1);
+                                value(a[i], depth + 1);
+                            }
+                            if (!a.empty())
+                                newline(depth);
+                            _out.put(']');
+                            break;
+                        }
+
+                    case Value::kvarray:
+                        {
+                            const KeyValueArray &kv = v.KV();
+                            _out.put('{');
+                            for (KeyValueArray::const_iterator it = kv.begin(); it != kv.end(); ++it)
+                            {
+                                if (it != kv.begin())
+                                    _out.put(',');
+                                newline(depth + 1);
+                                string(it->first);
+                                if (_pretty)
+                                    _out.write(" : ", 3);
+                                else
+                                    _out.put(':');
+                                value(it->second, depth + 1);
+                            }
+                            if (!kv.empty())
+                                newline(depth);
+                            _out.put('}');
+                            break;
+                        }
+                }
+            }
+    };
+
+    // Deeper than anything we store, and shallow enough not to exhaust the stack.
+    const unsigned max_depth = 256;
+
+    /*
+     * Parses JSON straight into a Value in one pass over the text, accepting
+     * what Json::Reader did: comments are skipped, booleans become 0 and 1, and
+     * numbers must be integers that fit in an int.
+     */
+    class JsonParser
+    {
+        private:
+            const char *_begin, *_p, *_end;
+
+            void fail(const std::string & what)
+            {
+                throw IOError(what + " at line " + paludis::stringify(1 + std::count(_begin, _p, '\n')));
+            }
+
+            void skip()
+            {
+                while (_p < _end)
+                {
+                    if (*_p == ' ' || *_p == '\t' || *_p == '\n' || *_p == '\r')
+                        ++_p;
+                    else if (*_p == '/' && _end - _p > 1 && _p[1] == '/')
+                        _p = std::find(_p, _end, '\n');
+                    else if (*_p == '/' && _end - _p > 1 && _p[1] == '*')
                     {
-                        ret[it->first] = EirValueToJsonValue(it->second);
+                        static const char close[] = "*/";
+                        const char *c = std::search(_p + 2, _end, close, close + 2);
+                        if (c == _end)
+                            fail("Unterminated comment");
+                        _p = c + 2;
                     }
-                    return ret;
+                    else
+                        break;
                 }
-            default:
-                throw InternalError("Unknown value type when converting to json");
-        }
-    }
+            }
 
-    eir::Value JsonValueToEirValue(const Json::Value &v)
-    {
-        switch (v.type())
-        {
-            case Json::nullValue:
-                return Value(Value::empty);
+            void expect(char c)
+            {
+                skip();
+                if (_p == _end || *_p != c)
+                    fail(std::string("Expected '") + c + "'");
+                ++_p;
+            }
+
+            void literal(const char *word, std::size_t len)
+            {
+                if (std::size_t(_end - _p) < len || std::memcmp(_p, word, len) != 0)
+                    fail("Unexpected characters");
+                _p += len;
+            }
+
+            Value number()
+            {
+                bool negative = *_p == '-';
+                if (negative)
+                    ++_p;
+                if (_p == _end || *_p < '0' || *_p > '9')
+                    fail("Malformed number");
+
+                long long n = 0;
+                for (; _p < _end && *_p >= '0' && *_p <= '9'; ++_p)
+                {
+                    n = n * 10 + (*_p - '0');
+                    if (n > 1LL + INT_MAX)
+                        fail("Number out of range");
+                }
 
-            case Json::intValue:
-            case Json::uintValue:
-            case Json::booleanValue:
-                return Value(v.asInt());
+                if (_p < _end && (*_p == '.' || *_p == 'e' || *_p == 'E'))
+                    fail("Can't represent floating-point numbers");
+                if (negative)
+                    n = -n;
+                if (n > INT_MAX)
+                    fail("Number out of range");
 
-            case Json::realValue:
-                throw InternalError("Can't represent floating-point numbers");
+                return Value(int(n));
+            }
 
-            case Json::stringValue:
-                return Value(v.asString());
+            unsigned hex4()
+            {
+                if (_end - _p < 4)
+                    fail("Malformed \\u escape");
+
+                unsigned ret = 0;
+                for (int i = 0; i < 4; ++i, ++_p)
+                {
+                    char c = *_p;
+                    ret <<= 4;
+                    if (c >= '0' && c <= '9')
+                        ret |= c - '0';
+                    else if (c >= 'a' && c <= 'f')
+                        ret |= c - 'a' + 10;
+                    else if (c >= 'A' && c <= 'F')
+                        ret |= c - 'A' + 10;
+                    else
+                        fail("Malformed \\u escape");
+                }
+                return ret;
+            }
+
+            void unicode(std::string & out)
+            {
+                unsigned cp = hex4();
+                if (cp >= 0xD800 && cp <= 0xDBFF && _end - _p >= 6 && _p[0] == '\\' && _p[1] == 'u')
+                {
+                    _p += 2;
+                    unsigned low = hex4();
+                    if (low < 0xDC00 || low > 0xDFFF)
+                        fail("Malformed surrogate pair");
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                }
 
-            case Json::arrayValue:
+                if (cp < 0x80)
+                    out += char(cp);
+                else if (cp < 0x800)
                 {
-                    Value ret(Value::array);
-                    for (Json::ValueIterator it = v.begin(); it != v.end(); ++it)
+                    out += char(0xC0 | (cp >> 6));
+                    out += char(0x80 | (cp & 0x3F));
+                }
+                else if (cp < 0x10000)
+                {
+                    out += char(0xE0 | (cp >> 12));
+                    out += char(0x80 | ((cp >> 6) & 0x3F));
+                    out += char(0x80 | (cp & 0x3F));
+                }
+                else
+                {
+                    out += char(0xF0 | (cp >> 18));
+                    out += char(0x80 | ((cp >> 12) & 0x3F));
+                    out += char(0x80 | ((cp >> 6) & 0x3F));
+                    out += char(0x80 | (cp & 0x3F));
+                }
+            }
+
+            void string(std::string & out)
+            {
+                const char *start = ++_p;
+
+                // Most strings have no escapes in them, and can be copied whole.
+                while (_p < _end && *_p != '"' && *_p != '\\')
+                    ++_p;
+                out.assign(start, _p);
+
+                while (true)
+                {
+                    if (_p == _end)
+                        fail("Unterminated string");
+
+                    char c = *_p++;
+                    if (c == '"')
+                        return;
+                    if (c != '\\')
+                    {
+                        out += c;
+                        continue;
+                    }
+
+                    if (_p == _end)
+                        fail("Unterminated string");
+                    switch (*_p++)
                     {
-                        ret.push_back(JsonValueToEirValue(*it));
+                        case '"':  out += '"';  break;
+                        case '\\': out += '\\'; break;
+                        case '/':  out += '/';  break;
+                        case 'b':  out += '\b'; break;
+                        case 'f':  out += '\f'; break;
+                        case 'n':  out += '\n'; break;
+                        case 'r':  out += '\r'; break;
+                        case 't':  out += '\t'; break;
+                        case 'u':  unicode(out); break;
+                        default:
+                            fail("Unknown escape sequence");
                     }
+                }
+            }
+
+            Value array(unsigned depth)
+            {
+                Value ret(Value::array);
+                ++_p;
+
+                skip();
+                if (_p < _end && *_p == ']')
+                {
+                    ++_p;
                     return ret;
                 }
 
-            case Json::objectValue:
+                while (true)
                 {
-                    Value ret(Value::kvarray);
-                    Json::Value::Members members(v.getMemberNames());
-                    for (Json::Value::Members::iterator it = members.begin(); it != members.end(); ++it)
+                    ret.push_back(value(depth + 1));
+                    skip();
+                    if (_p < _end && *_p == ',')
+                        ++_p;
+                    else
                     {
-                        ret.KV().insert(*it, JsonValueToEirValue(v.get(*it, Json::Value::null)));
+                        expect(']');
+                        return ret;
                     }
+                }
+            }
+
+            Value object(unsigned depth)
+            {
+                Value ret(Value::kvarray);
+                KeyValueArray &kv = ret.KV();
+                std::string key;
+                ++_p;
+
+                skip();
+                if (_p < _end && *_p == '}')
+                {
+                    ++_p;
                     return ret;
                 }
-            default:
-                throw InternalError("Unknown json value type");
-        }
-    }
+
+                while (true)
+                {
+                    skip();
+                    if (_p == _end || *_p != '"')
+                        fail("Expected a member name");
+                    string(key);
+                    expect(':');
+
+                    // As with Json::Reader, the last of any repeated member wins.
+                    Value v = value(depth + 1);
+                    if (!kv.insert(key, v))
+                        kv[key] = std::move(v);
+
+                    skip();
+                    if (_p < _end && *_p == ',')
+                        ++_p;
+                    else
+                    {
+                        expect('}');
+                        return ret;
+                    }
+                }
+            }
+
+            Value value(unsigned depth)
+            {
+                if (depth > max_depth)
+                    fail("Nested too deeply");
+
+                skip();
+                if (_p == _end)
+                    fail("Unexpected end of input");
+
+                switch (*_p)
+                {
+                    case '{':
+                        return object(depth);
+                    case '[':
+                        return array(depth);
+                    case '"':
+                        {
+                            std::string s;
+                            string(s);
+                            return Value(std::move(s));
+                        }
+                    case 't':
+                        literal("true", 4);
+                        return Value(1);
+                    case 'f':
+                        literal("false", 5);
+                        return Value(0);
+                    case 'n':
+                        literal("null", 4);
+                        return Value();
+                    default:
+                        if (*_p == '-' || (*_p >= '0' && *_p <= '9'))
+                            return number();
+                        fail("Unexpected character");
+                        return Value();
+                }
+            }
+
+        public:
+            JsonParser(const char *begin, const char *end)
+                : _begin(begin), _p(begin), _end(end)
+            { }
+
+            Value parse()
+            {
+                Value ret = value(0);
+                skip();
+                if (_p != _end)
+                    fail("Trailing data");
+                return ret;
+            }
+    };
+
+    class MappedFile
+    {
+        private:
+            const char *_data;
+            std::size_t _size;
+
+        public:
+            MappedFile(const std::string & filename)
+                : _data(0), _size(0)
+            {
+                int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+                struct stat st;
+                if (fd < 0 || fstat(fd, &st) < 0)
+                {
+                    if (fd >= 0)
+                        close(fd);
+                    throw IOError("Error reading from " + filename);
+                }
+
+                if (st.st_size > 0)
+                {
+                    void *p = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                    if (p == MAP_FAILED)
+                    {
+                        close(fd);
+                        throw IOError("Error reading from " + filename);
+                    }
+                    madvise(p, st.st_size, MADV_SEQUENTIAL);
+                    _data = static_cast<const char *>(p);
+                    _size = st.st_size;
+                }
+                close(fd);
+            }
+
+            ~MappedFile()
+            {
+                if (_data)
+                    munmap(const_cast<char *>(_data), _size);
+            }
+
+            const char *begin() const { return _data; }
+            const char *end() const { return _data + _size; }
+    };
 }
 
-struct JsonStorage : Module, StorageBackend
+struct JsonStorage : CommandHandlerBase<JsonStorage>, Module, StorageBackend
 {
+    // Set from the main thread, read on the storage writer thread.
+    std::atomic<bool> pretty;
+
     void Save(const Value & v, std::string target)
     {
-        Json::Value jv = EirValueToJsonValue(v);
-        Json::StyledWriter writer;
-        std::string filename(DATADIR "/" + target);
-        std::ofstream fs(filename.c_str());
-        fs << writer.write(jv);
-        if (!fs)
-            throw IOError("Error writing json output to " + filename);
+        AtomicFileWriter file(DATADIR "/" + target);
+        JsonWriter(file, pretty).value(v);
+        file.put('\n');
+        file.commit();
     }
 
     Value Load(std::string source)
     {
         std::string filename(DATADIR "/" + source);
-        std::ifstream fs(filename.c_str());
-        Json::Reader reader;
-        Json::Value jv;
-        std::string raw;
-
-        // Icky hack coming up
-        std::stringstream ss;
-        ss << fs.rdbuf();
-        raw = ss.str();
+        MappedFile file(filename);
 
-        if (!fs || !ss)
-            throw IOError("Error reading from " + filename);
+        try
+        {
+            return JsonParser(file.begin(), file.end()).parse();
+        }
+        catch (IOError & e)
+        {
+            throw IOError("Couldn't parse json input from " + filename + ": " + e.message());
+        }
+    }
 
-        if (!reader.parse(raw, jv))
-            throw IOError("Couldn't parse json input from " + filename);
+    void set_format(const Message *m)
+    {
+        if (m->args.empty())
+            return;
 
-        return JsonValueToEirValue(jv);
+        if (m->args[0] == "pretty")
+            pretty = true;
+        else if (m->args[0] == "compact")
+            pretty = false;
+        else
+            Logger::get_instance()->Log(NULL, NULL, Logger::Warning,
+                    "Unknown json_format " + m->args[0] + "; expected pretty or compact");
     }
 
     StorageBackendHolder backendid;
+    CommandHolder format_id;
 
     JsonStorage()
+        : pretty(true)
     {
         backendid = StorageManager::get_instance()->register_backend("json", this);
+        format_id = add_handler(filter_command_type("json_format", sourceinfo::ConfigFile), &JsonStorage::set_format);
     }
 };
 
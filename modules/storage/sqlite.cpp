@@ -0,0 +1,383 @@
+#include "eir.h"
+#include "storage.h"
+#include "value_binary.h"
+
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include <sqlite3.h>
+
+using namespace eir;
+
+/*
+ * Keeps every target in one SQLite database, with a row for each entry of a
+ * top-level array or kvarray, so that a save only touches the entries that
+ * changed since the last one. Each row holds its entry in the binary value
+ * encoding. Array entries are keyed by an id that stays with the entry, and
+ * ordered by a separate position column spaced out to leave room for
+ * insertions; kvarray entries are keyed by their key. Anything else is stored
+ * as a single row.
+ */
+
+namespace
+{
+    const char *schema =
+        "CREATE TABLE IF NOT EXISTS targets ("
+        "    name TEXT PRIMARY KEY,"
+        "    type INTEGER NOT NULL"
+        ");"
+        "CREATE TABLE IF NOT EXISTS records ("
+        "    target TEXT NOT NULL,"
+        "    key NOT NULL,"
+        "    pos INTEGER,"
+        "    value BLOB NOT NULL,"
+        "    PRIMARY KEY (target, key)"
+        ");"
+        "CREATE INDEX IF NOT EXISTS records_pos ON records (target, pos);";
+
+    // The space left between the positions of neighbouring array entries.
+    const sqlite3_int64 position_gap = 1 << 20;
+    // How far ahead to look for an entry when matching up old and new arrays.
+    const std::size_t resync_distance = 16;
+}
+
+struct SqliteStorage : Module, StorageBackend
+{
+    sqlite3 *db;
+    sqlite3_stmt *begin, *commit, *rollback, *get_type, *set_type, *get_records,
+                 *put_record, *set_position, *delete_record, *delete_target;
+
+    // What we last saved to, or loaded from, each target, and for arrays the
+    // id and position of each entry.
+    struct Target
+    {
+        Value value;
+        std::vector<sqlite3_int64> ids, positions;
+        sqlite3_int64 next_id;
+    };
+
+    std::mutex lock;
+    std::map<std::string, Target> targets;
+
+    void check(int rc)
+    {
+        if (rc != SQLITE_OK && rc != SQLITE_ROW && rc != SQLITE_DONE)
+            throw IOError(std::string("SQLite error: ") + sqlite3_errmsg(db));
+    }
+
+    sqlite3_stmt *prepare(const char *sql)
+    {
+        sqlite3_stmt *stmt;
+        check(sqlite3_prepare_v2(db, sql, -1, &stmt, 0));
+        return stmt;
+    }
+
+    // Runs a statement that returns no rows, and makes it ready for reuse.
+    void run(sqlite3_stmt *stmt)
+    {
+        int rc = sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+        check(rc);
+    }
+
+    void bind(sqlite3_stmt *stmt, int col, const std::string & s)
+    {
+        check(sqlite3_bind_text(stmt, col, s.data(), s.size(), SQLITE_TRANSIENT));
+    }
+
+    void bind(sqlite3_stmt *stmt, int col, sqlite3_int64 i)
+    {
+        check(sqlite3_bind_int64(stmt, col, i));
+    }
+
+    void bind(sqlite3_stmt *stmt, int col, const Value & v)
+    {
+        std::string data = binary::encode(v);
+        check(sqlite3_bind_blob(stmt, col, data.data(), data.size(), SQLITE_TRANSIENT));
+    }
+
+    void put(const std::string & target, sqlite3_int64 id, sqlite3_int64 pos, const Value & v)
+    {
+        bind(put_record, 1, target);
+        bind(put_record, 2, id);
+        bind(put_record, 3, pos);
+        bind(put_record, 4, v);
+        run(put_record);
+    }
+
+    void put(const std::string & target, const std::string & key, const Value & v)
+    {
+        bind(put_record, 1, target);
+        bind(put_record, 2, key);
+        bind(put_record, 4, v);
+        run(put_record);
+    }
+
+    template <typename Key_>
+    void remove(const std::string & target, const Key_ & key)
+    {
+        bind(delete_record, 1, target);
+        bind(delete_record, 2, key);
+        run(delete_record);
+    }
+
+    void rewrite(const Value & v, const std::string & target, Target & t)
+    {
+        bind(delete_target, 1, target);
+        run(delete_target);
+
+        bind(set_type, 1, target);
+        bind(set_type, 2, sqlite3_int64(v.Type()));
+        run(set_type);
+
+        t.ids.clear();
+        t.positions.clear();
+        t.next_id = 1;
+
+        if (v.Type() == Value::array)
+        {
+            const ValueArray &entries = v.Array();
+            for (std::size_t i = 0; i < entries.size(); ++i)
+            {
+                t.ids.push_back(t.next_id++);
+                t.positions.push_back((i + 1) * position_gap);
+                put(target, t.ids.back(), t.positions.back(), entries[i]);
+            }
+        }
+        else if (v.Type() == Value::kvarray)
+        {
+            for (KeyValueArray::const_iterator it = v.KV().begin(); it != v.KV().end(); ++it)
+                put(target, it->first, it->second);
+        }
+        else
+            put(target, 0, 0, v);
+    }
+
+    void update_kv(const Value & v, const std::string & target, Target & t)
+    {
+        const KeyValueArray &old = t.value.KV(), &current = v.KV();
+
+        for (KeyValueArray::const_iterator it = current.begin(); it != current.end(); ++it)
+        {
+            KeyValueArray::const_iterator prev = old.find(it->first);
+            if (prev == old.end() || !prev->second.equals(it->second))
+                put(target, it->first, it->second);
+        }
+
+        for (KeyValueArray::const_iterator it = old.begin(); it != old.end(); ++it)
+            if (current.find(it->first) == current.end())
+                remove(target, it->first);
+    }
+
+    /*
+     * Match each new entry up with an old one, looking a short way ahead to
+     * skip over entries that were removed. Entries that don't match are either
+     * changed in place, if what follows them still lines up, or new, and placed
+     * between their neighbours. Only if there's no room left between those do
+     * the positions all get renumbered.
+     */
+    void update_array(const Value & v, const std::string & target, Target & t)
+    {
+        const ValueArray &a = t.value.Array(), &b = v.Array();
+        std::vector<sqlite3_int64> ids, positions;
+        bool renumber = false;
+        std::size_t i = 0;
+
+        for (std::size_t j = 0; j < b.size(); ++j)
+        {
+            std::size_t skip = 0;
+            while (skip < resync_distance && i + skip < a.size() && !a[i + skip].equals(b[j]))
+                ++skip;
+
+            if (skip < resync_distance && i + skip < a.size())
+            {
+                for (; skip > 0; --skip, ++i)
+                    remove(target, t.ids[i]);
+                ids.push_back(t.ids[i]);
+                positions.push_back(t.positions[i]);
+                ++i;
+            }
+            else if (i < a.size() && (j + 1 == b.size() ? i + 1 == a.size()
+                                        : i + 1 < a.size() && a[i + 1].equals(b[j + 1])))
+            {
+                ids.push_back(t.ids[i]);
+                positions.push_back(t.positions[i]);
+                put(target, ids.back(), positions.back(), b[j]);
+                ++i;
+            }
+            else
+            {
+                sqlite3_int64 prev = positions.empty() ? 0 : positions.back();
+                sqlite3_int64 next = i < a.size() ? t.positions[i] : prev + 2 * position_gap;
+                if (next - prev < 2)
+                    renumber = true;
+
+                ids.push_back(t.next_id++);
+                positions.push_back(prev + (next - prev) / 2);
+                put(target, ids.back(), positions.back(), b[j]);
+            }
+        }
+
+        for (; i < a.size(); ++i)
+            remove(target, t.ids[i]);
+
+        if (renumber)
+        {
+            for (std::size_t k = 0; k < positions.size(); ++k)
+            {
+                positions[k] = (k + 1) * position_gap;
+                bind(set_position, 1, positions[k]);
+                bind(set_position, 2, target);
+                bind(set_position, 3, ids[k]);
+                run(set_position);
+            }
+        }
+
+        t.ids.swap(ids);
+        t.positions.swap(positions);
+    }
+
+    void Save(const Value & v, std::string target)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        try
+        {
+            run(begin);
+
+            std::map<std::string, Target>::iterator it = targets.find(target);
+            if (it == targets.end() || it->second.value.Type() != v.Type())
+                rewrite(v, target, targets[target]);
+            else if (v.Type() == Value::array)
+                update_array(v, target, it->second);
+            else if (v.Type() == Value::kvarray)
+                update_kv(v, target, it->second);
+            else if (!it->second.value.equals(v))
+                put(target, 0, 0, v);
+
+            run(commit);
+            targets[target].value = v;
+        }
+        catch (IOError &)
+        {
+            // We no longer know what's in the database for this target, so the
+            // next save writes it out afresh.
+            targets.erase(target);
+            sqlite3_step(rollback);
+            sqlite3_reset(rollback);
+            throw;
+        }
+    }
+
+    Value Load(std::string source)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        bind(get_type, 1, source);
+        int rc = sqlite3_step(get_type);
+        Value::ValueType type = Value::ValueType(sqlite3_column_int(get_type, 0));
+        sqlite3_reset(get_type);
+        sqlite3_clear_bindings(get_type);
+        check(rc);
+
+        if (rc != SQLITE_ROW)
+            throw IOError("No stored value named " + source);
+
+        Target t;
+        t.value = Value(type);
+        t.next_id = 1;
+
+        bind(get_records, 1, source);
+        try
+        {
+            while ((rc = sqlite3_step(get_records)) == SQLITE_ROW)
+            {
+                const char *blob = static_cast<const char *>(sqlite3_column_blob(get_records, 2));
+                Value v = binary::decode(std::string(blob, sqlite3_column_bytes(get_records, 2)));
+
+                if (type == Value::array)
+                {
+                    t.ids.push_back(sqlite3_column_int64(get_records, 0));
+                    t.positions.push_back(sqlite3_column_int64(get_records, 1));
+                    t.next_id = std::max(t.next_id, t.ids.back() + 1);
+                    t.value.push_back(v);
+                }
+                else if (type == Value::kvarray)
+                {
+                    const char *key = reinterpret_cast<const char *>(sqlite3_column_text(get_records, 0));
+                    t.value.KV().insert(std::string(key, sqlite3_column_bytes(get_records, 0)), v);
+                }
+                else
+                    t.value = v;
+            }
+            check(rc);
+        }
+        catch (IOError &)
+        {
+            sqlite3_reset(get_records);
+            sqlite3_clear_bindings(get_records);
+            throw;
+        }
+        sqlite3_reset(get_records);
+        sqlite3_clear_bindings(get_records);
+
+        targets[source] = t;
+        return t.value;
+    }
+
+    StorageBackendHolder backendid;
+
+    SqliteStorage()
+        : db(0), begin(0), commit(0), rollback(0), get_type(0), set_type(0), get_records(0),
+          put_record(0), set_position(0), delete_record(0), delete_target(0)
+    {
+        try
+        {
+            if (sqlite3_open_v2(DATADIR "/eir.sqlite", &db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, 0) != SQLITE_OK)
+                throw IOError(std::string("Couldn't open " DATADIR "/eir.sqlite: ") +
+                              (db ? sqlite3_errmsg(db) : "out of memory"));
+
+            sqlite3_busy_timeout(db, 5000);
+            check(sqlite3_exec(db, "PRAGMA journal_mode = WAL; PRAGMA synchronous = FULL;", 0, 0, 0));
+            check(sqlite3_exec(db, schema, 0, 0, 0));
+
+            begin = prepare("BEGIN IMMEDIATE");
+            commit = prepare("COMMIT");
+            rollback = prepare("ROLLBACK");
+            get_type = prepare("SELECT type FROM targets WHERE name = ?");
+            set_type = prepare("INSERT OR REPLACE INTO targets (name, type) VALUES (?, ?)");
+            get_records = prepare("SELECT key, pos, value FROM records WHERE target = ? ORDER BY pos");
+            put_record = prepare("INSERT OR REPLACE INTO records (target, key, pos, value) VALUES (?, ?, ?, ?)");
+            set_position = prepare("UPDATE records SET pos = ? WHERE target = ? AND key = ?");
+            delete_record = prepare("DELETE FROM records WHERE target = ? AND key = ?");
+            delete_target = prepare("DELETE FROM records WHERE target = ?");
+        }
+        catch (...)
+        {
+            close();
+            throw;
+        }
+
+        backendid = StorageManager::get_instance()->register_backend("sqlite", this);
+    }
+
+    void close()
+    {
+        sqlite3_stmt *stmts[] = { begin, commit, rollback, get_type, set_type, get_records,
+                                  put_record, set_position, delete_record, delete_target };
+        for (std::size_t i = 0; i < sizeof stmts / sizeof stmts[0]; ++i)
+            sqlite3_finalize(stmts[i]);
+        sqlite3_close(db);
+    }
+
+    ~SqliteStorage()
+    {
+        // Make sure nothing is still being written before the database goes away.
+        backendid = 0;
+        close();
+    }
+};
+
+MODULE_CLASS(SqliteStorage)
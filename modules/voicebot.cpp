@@ -78,10 +78,23 @@ namespace
         "\037reason\037 is given but \037time\037 is not, then the expiry will be left unchanged.";
 
 
+    // Every list entry has the same fields, so they're stored as records.
+    RecordSchema::ptr entry_schema()
+    {
+        static RecordSchema::ptr schema = RecordSchema::get({"bot", "mask", "setter", "reason", "set", "expires"});
+        return schema;
+    }
+
+    RecordSchema::ptr lost_entry_schema()
+    {
+        static RecordSchema::ptr schema = RecordSchema::get({"bot", "mask", "expires"});
+        return schema;
+    }
+
     Value voiceentry(std::string bot, std::string mask, std::string setter, std::string reason,
                      time_t set, time_t expires)
     {
-        Value v(Value::kvarray);
+        Value v = entry_schema()->make();
         v["bot"] = bot;
         v["mask"] = mask;
         v["setter"] = setter;
@@ -93,7 +106,7 @@ namespace
 
     Value lostvoiceentry(std::string bot, std::string mask, time_t expires)
     {
-        Value v(Value::kvarray);
+        Value v = lost_entry_schema()->make();
         v["bot"] = bot;
         v["mask"] = mask;
         v["expires"] = expires;
@@ -104,15 +117,32 @@ namespace
     {
         bool operator() (const Value& v)
         {
-            return v.Type() == Value::kvarray && v.KV().find("removed") != v.KV().end();
+            return v.Type() == Value::kvarray && v["removed"].Type() != Value::empty;
         }
     };
 
-    void do_removals(Value& list)
+    // Only takes non-const access to the list, which marks it as changed, if
+    // there's something to remove. If an expiry sweep is part way through the
+    // list, sweep_pos is moved back past the entries removed before it, so
+    // that it keeps its place.
+    void do_removals(Value& list, size_t *sweep_pos = NULL)
     {
-        Value newlist(Value::array);
-        std::remove_copy_if(list.begin(), list.end(), std::back_inserter(newlist.Array()), Removed());
-        std::swap(list, newlist);
+        const ValueArray &current = static_cast<const Value&>(list).Array();
+        if (std::find_if(current.begin(), current.end(), Removed()) == current.end())
+            return;
+
+        if (sweep_pos)
+        {
+            size_t before = 0;
+            for (size_t i = 0; i < *sweep_pos && i < current.size(); ++i)
+                if (Removed()(current[i]))
+                    ++before;
+            *sweep_pos -= before;
+        }
+
+        ValueArray &entries = list.Array();
+        ValueArray::iterator kept_end = std::remove_if(entries.begin(), entries.end(), Removed());
+        entries.resize(std::distance(entries.begin(), kept_end));
     }
 }
 
@@ -154,7 +184,8 @@ struct voicebot : CommandHandlerBase<voicebot>, Module
         if (mask.find_first_of("!@*") == std::string::npos)
             mask += "!*@*";
 
-        for (ValueArray::iterator it = dnv.begin(); it != dnv.end(); ++it)
+        const Value &entries = dnv;
+        for (ValueArray::const_iterator it = entries.begin(); it != entries.end(); ++it)
         {
             if (mask_match((*it)["mask"], mask))
             {
@@ -240,14 +271,15 @@ struct voicebot : CommandHandlerBase<voicebot>, Module
             }
         }
 
-        do_removals(dnv);
+        do_removals(dnv, &expiry_dnv_pos);
 
         Logger::get_instance()->Log(m->bot, m->source.client, Logger::Command, "REMOVE " + mask);
     }
 
     void do_list(const Message *m)
     {
-        for (ValueArray::iterator it = dnv.begin(); it != dnv.end(); ++it)
+        const Value &entries = dnv;
+        for (ValueArray::const_iterator it = entries.begin(); it != entries.end(); ++it)
         {
             Bot *bot = BotManager::get_instance()->find((*it)["bot"]);
             m->source.reply((*it)["mask"] + " (" + (*it)["reason"] + ") (added by " + 
@@ -262,13 +294,17 @@ struct voicebot : CommandHandlerBase<voicebot>, Module
                            std::list<std::string> *tovoice,
                            std::list<std::string> *tonotvoice)
     {
+        if (channel->mode_count('v') == channel->member_count())
+            return;
+
         for (Channel::MemberIterator it = channel->begin_members(); it != channel->end_members(); ++it)
         {
             if ((*it)->has_mode('v'))
                 continue;
 
             bool matched = false;
-            for (ValueArray::iterator i2 = dnv.begin(); i2 != dnv.end(); ++i2)
+            const Value &entries = dnv;
+            for (ValueArray::const_iterator i2 = entries.begin(); i2 != entries.end(); ++i2)
             {
                 if (match((*i2)["mask"], (*it)->client->nuh()))
                 {
@@ -365,7 +401,8 @@ struct voicebot : CommandHandlerBase<voicebot>, Module
                 mask = c->nuh();
         }
 
-        for (ValueArray::iterator it = dnv.begin(); it != dnv.end(); ++it)
+        const Value &entries = dnv;
+        for (ValueArray::const_iterator it = entries.begin(); it != entries.end(); ++it)
             if (mask_match((*it)["mask"], mask))
             {
                 Bot *bot = BotManager::get_instance()->find((*it)["bot"]);
@@ -377,69 +414,111 @@ struct voicebot : CommandHandlerBase<voicebot>, Module
         m->source.reply("*** End of DNV matches for " + mask);
     }
 
+    // The expiry sweep runs as an idle task, a chunk of entries at a time, so
+    // that large lists don't stall the main loop while they're checked.
+    // Each list has its own position, so that adding to one doesn't move the
+    // other, and do_removals keeps it in step when it compacts the list.
+    enum { expiry_chunk = 128 };
+    size_t expiry_dnv_pos, expiry_lostvoices_pos;
+
     void check_expiry()
     {
-        time_t currenttime = time(NULL);
-
-        for (ValueArray::iterator it = dnv.begin(); it != dnv.end(); ++it)
-        {
-            if ((*it)["expires"].Int() != 0 && (*it)["expires"].Int() < currenttime)
-            {
-                Bot *bot = BotManager::get_instance()->find((*it)["bot"]);
-                std::string adminchan;
-                if (bot)
-                    adminchan = bot->get_setting("voicebot_admin_channel");
+        expiry_dnv_pos = expiry_lostvoices_pos = 0;
+        expiry_task = add_idle_task(&voicebot::check_expiry_step, 2);
+    }
 
-                if (bot && !adminchan.empty())
-                    bot->send("NOTICE " + adminchan + " :Removing expired entry " +
-                            (*it)["mask"] + " added by " + (*it)["setter"] + " on " +
-                            format_time(bot, (*it)["set"].Int()));
+    static bool expired(const Value & entry, time_t currenttime)
+    {
+        return entry["expires"].Int() != 0 && entry["expires"].Int() < currenttime;
+    }
 
-                old.push_back(*it);
-                (*it)["removed"] = 1;
-            }
-        }
-        for (ValueArray::iterator it = lostvoices.begin(); it != lostvoices.end(); ++it)
+    void expire_entry(Value & entry, time_t currenttime)
+    {
+        if (expired(entry, currenttime))
         {
-            if ((*it)["expires"].Int() != 0 && (*it)["expires"].Int() < currenttime)
-            {
-                (*it)["removed"] = 1;
-            }
+            Bot *bot = BotManager::get_instance()->find(entry["bot"]);
+            std::string adminchan;
+            if (bot)
+                adminchan = bot->get_setting("voicebot_admin_channel");
+
+            if (bot && !adminchan.empty())
+                bot->send("NOTICE " + adminchan + " :Removing expired entry " +
+                        entry["mask"] + " added by " + entry["setter"] + " on " +
+                        format_time(bot, entry["set"].Int()));
+
+            old.push_back(entry);
+            entry["removed"] = 1;
         }
-
-        do_removals(dnv);
-        do_removals(lostvoices);
     }
 
-    void load_list(Value & v, std::string name)
+    void expire_lost_entry(Value & entry, time_t currenttime)
     {
-        try
+        if (expired(entry, currenttime))
         {
-            v = StorageManager::get_instance()->Load(name);
-            if (v.Type() != Value::array)
-                throw "wrong type";
+            entry["removed"] = 1;
         }
-        catch (StorageError &)
-        {
-            v = Value(Value::array);
-        }
-        catch (IOError &)
+    }
+
+    bool check_expiry_step()
+    {
+        time_t currenttime = time(NULL);
+        const Value &cdnv = dnv, &clostvoices = lostvoices;
+        size_t n_dnv = cdnv.Array().size(), n_lostvoices = clostvoices.Array().size();
+
+        // Most entries won't have expired, so look at them through const access
+        // and only modify the lists when something has.
+        for (int i = 0; i < expiry_chunk && expiry_dnv_pos < n_dnv; ++i, ++expiry_dnv_pos)
         {
-            v = Value(Value::array);
+            const Value & entry = cdnv.Array()[expiry_dnv_pos];
+
+            // Entries already dealt with may not have been swept out of the list yet.
+            if (!Removed()(entry) && expired(entry, currenttime))
+                expire_entry(dnv.Array()[expiry_dnv_pos], currenttime);
         }
-        catch (const char *)
+
+        for (int i = 0; i < expiry_chunk && expiry_lostvoices_pos < n_lostvoices; ++i, ++expiry_lostvoices_pos)
         {
-            Logger::get_instance()->Log(NULL, NULL, Logger::Warning,
-                    "Loaded voice list " + name + "has wrong type; ignoring");
-            v = Value(Value::array);
+            const Value & entry = clostvoices.Array()[expiry_lostvoices_pos];
+
+            if (!Removed()(entry) && expired(entry, currenttime))
+                expire_lost_entry(lostvoices.Array()[expiry_lostvoices_pos], currenttime);
         }
+
+        if (expiry_dnv_pos < n_dnv || expiry_lostvoices_pos < n_lostvoices)
+            return true;
+
+        do_removals(dnv, &expiry_dnv_pos);
+        do_removals(lostvoices, &expiry_lostvoices_pos);
+        return false;
+    }
+
+    void load_list(Value & v, std::string name, RecordSchema::ptr schema)
+    {
+        // Stays empty if there's nothing stored, or it can't be read.
+        v = Value(Value::array);
+
+        StorageManager::get_instance()->LoadAsync(name,
+            [&v, name, schema] (const Value & loaded) {
+                if (loaded.Type() != Value::array)
+                {
+                    Logger::get_instance()->Log(NULL, NULL, Logger::Warning,
+                            "Loaded voice list " + name + " has wrong type; ignoring");
+                    return;
+                }
+
+                v = loaded;
+                for (ValueArray::iterator it = v.begin(); it != v.end(); ++it)
+                    if (it->Type() == Value::kvarray)
+                        *it = schema->make(*it);
+            },
+            [] (const std::string &) { });
     }
 
     void load_lists()
     {
-        load_list(dnv, "donotvoice");
-        load_list(old, "expireddonotvoice");
-        load_list(lostvoices, "lostvoices");
+        load_list(dnv, "donotvoice", entry_schema());
+        load_list(old, "expireddonotvoice", entry_schema());
+        load_list(lostvoices, "lostvoices", lost_entry_schema());
     }
 
     std::string build_revoice_mask (Client::ptr c)
@@ -496,22 +575,23 @@ struct voicebot : CommandHandlerBase<voicebot>, Module
         if (m->source.destination != channelname)
             return;
 
-        for (ValueArray::iterator it = lostvoices.begin(); it != lostvoices.end(); ++it)
+        const Value &entries = lostvoices;
+        for (size_t i = 0; i < entries.Array().size(); ++i)
         {
-            if (mask_match((*it)["mask"], m->source.raw))
+            if (mask_match(entries[i]["mask"], m->source.raw))
             {
                 Client::ptr c = m->bot->find_client(m->source.name);
                 if (c)
                 {
                     std::weak_ptr<Client> w(c);
-                    Logger::get_instance()->Log(m->bot, NULL, Logger::Debug, "*** Matched lost voice for " + m->source.raw + "(" + (*it)["mask"] + ")");
-                    Logger::get_instance()->Log(m->bot, NULL, Logger::Debug, "*** Queueing revoice for " + m->source.name);
+                    Logger::get_instance()->Log(m->bot, NULL, Logger::Debug, [&] { return "*** Matched lost voice for " + m->source.raw + "(" + entries[i]["mask"] + ")"; });
+                    Logger::get_instance()->Log(m->bot, NULL, Logger::Debug, [&] { return "*** Queueing revoice for " + m->source.name; });
                     add_event(time(NULL)+5, std::bind(revoice, m->bot, w, channelname));
-                    (*it)["removed"]=1;
+                    lostvoices[i]["removed"]=1;
                 }
             }
         }
-        do_removals(lostvoices);
+        do_removals(lostvoices, &expiry_lostvoices_pos);
     }
 
     void irc_nick(const Message *m)
@@ -526,18 +606,19 @@ struct voicebot : CommandHandlerBase<voicebot>, Module
         if (m->source.name == m->bot->nick())
             return;
 
-        for (ValueArray::iterator it = lostvoices.begin(); it != lostvoices.end(); ++it)
+        const Value &entries = lostvoices;
+        for (size_t i = 0; i < entries.Array().size(); ++i)
         {
-            if (mask_match((*it)["mask"], m->source.client->nuh()))
+            if (mask_match(entries[i]["mask"], m->source.client->nuh()))
             {
                 std::weak_ptr<Client> w(m->source.client);
-                Logger::get_instance()->Log(m->bot, NULL, Logger::Debug, "*** Matched lost voice for " + m->source.raw + "(" + (*it)["mask"] + ")");
-                Logger::get_instance()->Log(m->bot, NULL, Logger::Debug, "*** Queueing revoice for " + m->source.destination );
+                Logger::get_instance()->Log(m->bot, NULL, Logger::Debug, [&] { return "*** Matched lost voice for " + m->source.raw + "(" + entries[i]["mask"] + ")"; });
+                Logger::get_instance()->Log(m->bot, NULL, Logger::Debug, [&] { return "*** Queueing revoice for " + m->source.destination; });
                 add_event(time(NULL)+5, std::bind(revoice, m->bot, w, channelname));
-                (*it)["removed"]=1;
+                lostvoices[i]["removed"]=1;
             }
         }
-        do_removals(lostvoices);
+        do_removals(lostvoices, &expiry_lostvoices_pos);
     }
 
     void irc_depart (const Message *m)
@@ -563,7 +644,7 @@ struct voicebot : CommandHandlerBase<voicebot>, Module
                 if (m->args.size() >= 1 && m->args[0].substr(0,9) == "requested")
                 {
                     // user was ejected from the channel with REMOVE
-                    Logger::get_instance()->Log(m->bot, NULL, Logger::Debug, "*** " + m->source.client->nick()  + "was removed from channel - will not revoice");
+                    Logger::get_instance()->Log(m->bot, NULL, Logger::Debug, [&] { return "*** " + m->source.client->nick()  + "was removed from channel - will not revoice"; });
                     return;
                 }
             } else if (m->command == "QUIT") {
@@ -573,7 +654,7 @@ struct voicebot : CommandHandlerBase<voicebot>, Module
                     if (q == "Killed" ||  q == "K-Lined" ||  q == "Changing" ||  q == "*.net")
                     {
                         // Abnormal quit - ignore
-                        Logger::get_instance()->Log(m->bot, NULL, Logger::Debug, "*** " + m->source.client->nick()  + "left network abnormally - will not revoice");
+                        Logger::get_instance()->Log(m->bot, NULL, Logger::Debug, [&] { return "*** " + m->source.client->nick()  + "left network abnormally - will not revoice"; });
                         return;
                     }
                 }
@@ -587,16 +668,17 @@ struct voicebot : CommandHandlerBase<voicebot>, Module
             if (!mask.empty())
             {
                 // check we don't already have this mask
-                for (ValueArray::iterator it = lostvoices.begin(); it != lostvoices.end(); ++it)
+                const Value &entries = lostvoices;
+                for (ValueArray::const_iterator it = entries.begin(); it != entries.end(); ++it)
                 {
                     if ((*it)["mask"] == mask)
                     {
-                        Logger::get_instance()->Log(m->bot, NULL, Logger::Debug, "*** " + mask + " is already on lostvoices list, skipping");
+                        Logger::get_instance()->Log(m->bot, NULL, Logger::Debug, [&] { return "*** " + mask + " is already on lostvoices list, skipping"; });
                         return;
                     }
                 }
                 lostvoices.push_back(lostvoiceentry(m->bot->name(), mask, get_revoice_expiry(m->bot)+time(NULL)));
-                Logger::get_instance()->Log(m->bot, NULL, Logger::Debug, "*** " + m->source.client->nick() + "(" + mask + ")" + " left " + channelname + " with voice");
+                Logger::get_instance()->Log(m->bot, NULL, Logger::Debug, [&] { return "*** " + m->source.client->nick() + "(" + mask + ")" + " left " + channelname + " with voice"; });
             }
         }
     }
@@ -617,16 +699,16 @@ struct voicebot : CommandHandlerBase<voicebot>, Module
 
         if (mem->has_mode('v'))
         {
-            Logger::get_instance()->Log(bot, NULL, Logger::Debug, "**** " + c->nick() + " is alreadly voiced on " + channel +", skipping");
+            Logger::get_instance()->Log(bot, NULL, Logger::Debug, [&] { return "**** " + c->nick() + " is alreadly voiced on " + channel +", skipping"; });
         } else {
-            Logger::get_instance()->Log(bot, NULL, Logger::Debug, "*** Revoicing " + c->nick() + " on "+ channel);
+            Logger::get_instance()->Log(bot, NULL, Logger::Debug, [&] { return "*** Revoicing " + c->nick() + " on "+ channel; });
             Logger::get_instance()->Log(bot, NULL, Logger::Admin, "*** Revoicing " + c->nick() + " on "+ channel);
             bot->send("MODE " + channel + " +v " + c->nick());
         }
     }
 
     CommandHolder add, remove, list, info, check, voice, clear, change, match_client, shutdown, join, part, quit, nick;
-    EventHolder check_event;
+    EventHolder check_event, expiry_task;
     HelpTopicHolder voicebothelp, voicehelp, checkhelp, matchhelp, addhelp, removehelp, edithelp;
     HelpIndexHolder index;
 
@@ -634,6 +716,7 @@ struct voicebot : CommandHandlerBase<voicebot>, Module
         : dnv(GlobalSettingsManager::get_instance()->get("voicebot:donotvoice")),
           old(GlobalSettingsManager::get_instance()->get("voicebot:expireddonotvoice")),
           lostvoices(GlobalSettingsManager::get_instance()->get("voicebot:lostvoices")),
+          expiry_dnv_pos(0), expiry_lostvoices_pos(0),
           voicebothelp("voicebot", "voiceadmin", help_voicebot),
           voicehelp("voice", "voiceadmin", help_voice),
           checkhelp("voice_check", "voiceadmin", help_check),
@@ -662,7 +745,7 @@ struct voicebot : CommandHandlerBase<voicebot>, Module
         join = add_handler(filter_command_type("JOIN", sourceinfo::RawIrc),&voicebot::irc_join,true);
         nick = add_handler(filter_command_type("NICK", sourceinfo::RawIrc),&voicebot::irc_nick,true);
 
-        check_event = add_recurring_event(60, &voicebot::check_expiry);
+        check_event = add_recurring_event(60, &voicebot::check_expiry, 15);
 
         StorageManager::get_instance()->auto_save(&dnv, "donotvoice");
         StorageManager::get_instance()->auto_save(&old, "expireddonotvoice");
@@ -135,7 +135,7 @@ our @handlers;
             Eir::CommandRegistry::add_handler(Eir::Filter->new({command => 'btsaveconfig',type => Eir::Source::IrcCommand}),\&cmd_btsaveconfig),
             Eir::CommandRegistry::add_handler(Eir::Filter->new({command => 'btloadconfig',type => Eir::Source::IrcCommand}),\&cmd_btloadconfig),
             # Recurring Events
-            Eir::EventManager::add_recurring_event(60, \&nag_expired)
+            Eir::EventManager::add_recurring_event(60, \&nag_expired, 15)
            );
 
 # The following are only required if logging is in use, so we'll only register them if logging has been enabled globally
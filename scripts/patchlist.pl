@@ -22,7 +22,7 @@ our @handlers = (
     Eir::CommandRegistry::add_handler( Eir::Filter->new({ command => "patchdone" }), \&patchdone ),
     Eir::CommandRegistry::add_handler( Eir::Filter->new({ command => "pad", privilege => "patchadmin" }), \&patchalldone ),
     Eir::CommandRegistry::add_handler( Eir::Filter->new({ command => "patchalldone", privilege => "patchadmin" }), \&patchalldone ),
-    Eir::EventManager::add_recurring_event(3600, \&slacker_alert)
+    Eir::EventManager::add_recurring_event(3600, \&slacker_alert, 300)
 );
 
 my ($patches, $done_patches);
@@ -0,0 +1,64 @@
+#include "attributes.h"
+#include "exceptions.h"
+
+#include <unordered_map>
+
+using namespace eir;
+
+namespace
+{
+    struct AttributeRegistry
+    {
+        std::unordered_map<std::string, AttributeSlot> slots;
+        std::vector<std::string> names;
+    };
+
+    AttributeRegistry &registry()
+    {
+        static AttributeRegistry r;
+        return r;
+    }
+}
+
+AttributeSlot eir::attribute_slot(const std::string &name)
+{
+    AttributeRegistry &r = registry();
+
+    std::unordered_map<std::string, AttributeSlot>::iterator it = r.slots.find(name);
+    if (it != r.slots.end())
+        return it->second;
+
+    if (r.names.size() > AttributeSlot(-1))
+        throw InternalError("Too many attribute names registered");
+
+    AttributeSlot slot = r.names.size();
+    r.names.push_back(name);
+    r.slots.insert(std::make_pair(name, slot));
+    return slot;
+}
+
+bool eir::find_attribute_slot(const std::string &name, AttributeSlot &slot)
+{
+    AttributeRegistry &r = registry();
+
+    std::unordered_map<std::string, AttributeSlot>::iterator it = r.slots.find(name);
+    if (it == r.slots.end())
+        return false;
+
+    slot = it->second;
+    return true;
+}
+
+const std::string &eir::attribute_name(AttributeSlot slot)
+{
+    AttributeRegistry &r = registry();
+    if (slot >= r.names.size())
+        throw NotFoundError("No attribute registered in that slot");
+    return r.names[slot];
+}
+
+const Value &AttributeSet::empty_value()
+{
+    static const Value empty;
+    return empty;
+}
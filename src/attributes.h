@@ -0,0 +1,85 @@
+#ifndef attributes_h
+#define attributes_h
+
+#include "value.h"
+
+#include <string>
+#include <vector>
+#include <utility>
+
+namespace eir
+{
+    /*
+     * Attribute names are registered once, globally, and map to a small integer
+     * slot. Objects that carry attributes store only the slots they actually use,
+     * so an object with no attributes costs nothing beyond an empty vector.
+     */
+    typedef unsigned short AttributeSlot;
+
+    AttributeSlot attribute_slot(const std::string &name);
+    bool find_attribute_slot(const std::string &name, AttributeSlot &slot);
+    const std::string &attribute_name(AttributeSlot slot);
+
+    class AttributeSet
+    {
+        public:
+            typedef std::pair<AttributeSlot, Value> entry;
+            typedef std::vector<entry>::iterator iterator;
+            typedef std::vector<entry>::const_iterator const_iterator;
+
+            iterator begin() { return _entries.begin(); }
+            iterator end() { return _entries.end(); }
+            const_iterator begin() const { return _entries.begin(); }
+            const_iterator end() const { return _entries.end(); }
+
+            Value *find(AttributeSlot slot)
+            {
+                for (iterator it = _entries.begin(); it != _entries.end(); ++it)
+                    if (it->first == slot)
+                        return &it->second;
+                return 0;
+            }
+
+            const Value *find(AttributeSlot slot) const
+            {
+                return const_cast<AttributeSet *>(this)->find(slot);
+            }
+
+            // A shared, empty Value is returned for unset attributes.
+            const Value &get(AttributeSlot slot) const
+            {
+                const Value *v = find(slot);
+                return v ? *v : empty_value();
+            }
+
+            void set(AttributeSlot slot, const Value &value)
+            {
+                if (Value *v = find(slot))
+                    *v = value;
+                else
+                    _entries.push_back(entry(slot, value));
+            }
+
+            bool erase(AttributeSlot slot)
+            {
+                for (iterator it = _entries.begin(); it != _entries.end(); ++it)
+                {
+                    if (it->first == slot)
+                    {
+                        _entries.erase(it);
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            std::size_t heap_bytes() const { return _entries.capacity() * sizeof(entry); }
+
+            static const Value &empty_value();
+
+        private:
+            std::vector<entry> _entries;
+    };
+}
+
+#endif
@@ -42,6 +42,7 @@ namespace paludis
     {
         typedef std::unordered_map<std::string, Client::ptr, cistring::hasher, cistring::is_equal> ClientMap;
         typedef std::unordered_map<std::string, Channel::ptr, cistring::hasher, cistring::is_equal> ChannelMap;
+        typedef std::unordered_multimap<std::string, Client::ptr, cistring::hasher, cistring::is_equal> ClientIndex;
         typedef std::map<std::string, Value> SettingsMap;
 
         Bot *bot;
@@ -55,6 +56,7 @@ namespace paludis
 
         ClientMap _clients;
         ChannelMap _channels;
+        ClientIndex _clients_by_host, _clients_by_account, _clients_by_userhost;
         SettingsMap _settings;
 
         bool _connected;
@@ -82,6 +84,51 @@ namespace paludis
             if (m->args.empty()) return;
             if (m->args[0] == "WHOX")
                 have_whox = true;
+            if (m->args[0] == "CASEMAPPING" && m->bot == bot)
+                set_casemapping(_supported.casemapping());
+        }
+
+        const unsigned char *_casemap;
+
+        template <class Map_>
+        void rehash_map(Map_ &map)
+        {
+            Map_ newmap(map.bucket_count(), cistring::hasher(_casemap), cistring::is_equal(_casemap));
+            newmap.insert(map.begin(), map.end());
+            map.swap(newmap);
+        }
+
+        // If two names collide under the new mapping, only one of them is kept.
+        void set_casemapping(cistring::casemapping m)
+        {
+            const unsigned char *tab = cistring::table_for(m);
+            if (tab == _casemap)
+                return;
+            _casemap = tab;
+            rehash_map(_clients);
+            rehash_map(_channels);
+            rehash_map(_clients_by_host);
+            rehash_map(_clients_by_account);
+            rehash_map(_clients_by_userhost);
+        }
+
+        static void index_add(ClientIndex &index, const std::string &key, Client::ptr c)
+        {
+            if (!key.empty())
+                index.insert(std::make_pair(key, c));
+        }
+
+        static void index_remove(ClientIndex &index, const std::string &key, Client::ptr c)
+        {
+            std::pair<ClientIndex::iterator, ClientIndex::iterator> r = index.equal_range(key);
+            for (ClientIndex::iterator it = r.first; it != r.second; ++it)
+            {
+                if (it->second == c)
+                {
+                    index.erase(it);
+                    return;
+                }
+            }
         }
 
         void handle_message(std::string);
@@ -147,8 +194,10 @@ namespace paludis
         Implementation(Bot *b, std::string n)
             : bot(b), _name(n),
               _clients(512), _channels(512),
+              _clients_by_host(512), _clients_by_account(512), _clients_by_userhost(512),
               _connected(false),
-              _supported(b), _capabilities(b)
+              _supported(b), _capabilities(b),
+              _casemap(cistring::tolowertab)
         {
             config_filename = ETCDIR "/" + _name + ".conf";
             set_handler = add_handler(filter_command_privilege("set", "admin").from_bot(bot).or_config(),
@@ -169,6 +218,7 @@ namespace paludis
 
             _capabilities.request("account-notify");
             _capabilities.request("extended-join");
+            _capabilities.request("chghost");
         }
     };
 }
@@ -262,6 +312,7 @@ void Implementation<Bot>::rehash(const Message *m)
     dispatch_internal_message(bot, "clear_lists");
 
     load_config(m->source.reply_func);
+    StorageManager::get_instance()->finish_loads();
 
     dispatch_internal_message(bot, "recalculate_privileges");
 
@@ -353,7 +404,7 @@ void Implementation<Bot>::handle_message(std::string line)
     m.command = "server_incoming";
     m.source.type = sourceinfo::Internal;
     CommandRegistry::get_instance()->dispatch(&m);
-    Logger::get_instance()->Log(bot, m.source.client, Logger::Raw, "<-- " + m.raw);
+    Logger::get_instance()->Log(bot, m.source.client, Logger::Raw, [&m] { return "<-- " + m.raw; });
     m.command = command;
     m.source.type = sourceinfo::RawIrc;
     CommandRegistry::get_instance()->dispatch(&m);
@@ -429,6 +480,10 @@ void Bot::run()
     send("NICK " + _imp->_nick);
     send("USER " + ident + " * * :" + realname);
 
+    // Stored values have been loading while we connected; they need to be in
+    // place before anything comes in from the server.
+    StorageManager::get_instance()->finish_loads();
+
     _imp->_server->run();
 }
 
@@ -441,7 +496,7 @@ void Bot::send(std::string line)
     if (idx != std::string::npos)
         line.erase(idx);
 
-    Logger::get_instance()->Log(this, NULL, Logger::Raw, "--> " + line);
+    Logger::get_instance()->Log(this, NULL, Logger::Raw, [&line] { return "--> " + line; });
 
     _imp->_server->send(line);
 }
@@ -482,6 +537,8 @@ std::pair<Bot::ClientIterator, bool> Bot::add_client(Client::ptr c)
     std::pair<Implementation<Bot>::ClientMap::iterator, bool> res = _imp->_clients.insert(make_pair(c->nick(), c));
     if (res.second)
     {
+        index_client(c);
+
         Message m(this, "new_client", sourceinfo::Internal, c);
         CommandRegistry::get_instance()->dispatch(&m);
     }
@@ -496,7 +553,85 @@ unsigned long Bot::remove_client(Client::ptr c)
     Message m(this, "client_remove", sourceinfo::Internal, c);
     CommandRegistry::get_instance()->dispatch(&m);
 
-    return _imp->_clients.erase(c->nick());
+    Implementation<Bot>::ClientMap::iterator it = _imp->_clients.find(c->nick());
+    if (it == _imp->_clients.end() || it->second != c)
+        return 0;
+
+    unindex_client(c);
+    _imp->_clients.erase(it);
+    return 1;
+}
+
+void Bot::rename_client(Client::ptr c, std::string oldnick)
+{
+    Context ctx("Renaming client " + oldnick + " to " + c->nick());
+
+    Implementation<Bot>::ClientMap::iterator it = _imp->_clients.find(oldnick);
+    if (it != _imp->_clients.end() && it->second == c)
+        _imp->_clients.erase(it);
+
+    // Anything still holding the new nick is stale; the server has just given it to c.
+    // It goes away as if it had quit.
+    Implementation<Bot>::ClientMap::iterator stale = _imp->_clients.find(c->nick());
+    if (stale != _imp->_clients.end() && stale->second != c)
+    {
+        Client::ptr s = stale->second;
+
+        Client::ChannelIterator chi = s->begin_channels();
+        while (chi != s->end_channels())
+        {
+            Membership::ptr p = *chi++;
+            s->leave_chan(p);
+        }
+
+        remove_client(s);
+    }
+
+    _imp->_clients[c->nick()] = c;
+}
+
+void Bot::index_client(Client::ptr c)
+{
+    Implementation<Bot>::ClientMap::iterator it = _imp->_clients.find(c->nick());
+    if (it == _imp->_clients.end() || it->second != c)
+        return;
+
+    Implementation<Bot>::index_add(_imp->_clients_by_host, c->host(), c);
+    Implementation<Bot>::index_add(_imp->_clients_by_account, c->account(), c);
+    if (!c->host().empty())
+        Implementation<Bot>::index_add(_imp->_clients_by_userhost, c->user() + "@" + c->host(), c);
+}
+
+void Bot::unindex_client(Client::ptr c)
+{
+    Implementation<Bot>::index_remove(_imp->_clients_by_host, c->host(), c);
+    Implementation<Bot>::index_remove(_imp->_clients_by_account, c->account(), c);
+    Implementation<Bot>::index_remove(_imp->_clients_by_userhost, c->user() + "@" + c->host(), c);
+}
+
+namespace
+{
+    Bot::ClientRange index_range(Implementation<Bot>::ClientIndex &index, const std::string &key)
+    {
+        std::pair<Implementation<Bot>::ClientIndex::iterator, Implementation<Bot>::ClientIndex::iterator> r
+            = index.equal_range(key);
+        return Bot::ClientRange(second_iterator(r.first), second_iterator(r.second));
+    }
+}
+
+Bot::ClientRange Bot::find_clients_by_host(std::string host)
+{
+    return index_range(_imp->_clients_by_host, host);
+}
+
+Bot::ClientRange Bot::find_clients_by_account(std::string account)
+{
+    return index_range(_imp->_clients_by_account, account);
+}
+
+Bot::ClientRange Bot::find_clients_by_userhost(std::string userhost)
+{
+    return index_range(_imp->_clients_by_userhost, userhost);
 }
 
 // Channel stuff
@@ -555,12 +690,12 @@ Bot::SettingsIterator Bot::end_settings()
     return _imp->_settings.end();
 }
 
-Bot::SettingsIterator Bot::find_setting(std::string name)
+Bot::SettingsIterator Bot::find_setting(const std::string& name)
 {
     return _imp->_settings.find(name);
 }
 
-Value Bot::get_setting(std::string name)
+const Value& Bot::get_setting(const std::string& name)
 {
     SettingsIterator it = find_setting(name);
     if(it == end_settings())
@@ -568,7 +703,7 @@ Value Bot::get_setting(std::string name)
     return it->second;
 }
 
-Value Bot::get_setting_with_default(std::string name, std::string _default)
+Value Bot::get_setting_with_default(const std::string& name, std::string _default)
 {
     SettingsIterator it = find_setting(name);
     if(it == end_settings())
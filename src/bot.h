@@ -42,6 +42,17 @@ namespace eir
             Client::ptr find_client(std::string nick);
             std::pair<ClientIterator, bool> add_client(Client::ptr c);
             unsigned long remove_client(Client::ptr c);
+            void rename_client(Client::ptr c, std::string oldnick);
+
+            // Secondary indexes over tracked clients. A client's index entries must be
+            // removed with unindex_client before its user, host or account changes, and
+            // restored with index_client afterwards; Client's setters do this.
+            typedef std::pair<ClientIterator, ClientIterator> ClientRange;
+            ClientRange find_clients_by_host(std::string host);
+            ClientRange find_clients_by_account(std::string account);
+            ClientRange find_clients_by_userhost(std::string userhost);
+            void index_client(Client::ptr c);
+            void unindex_client(Client::ptr c);
 
             struct ChannelIteratorTag;
             typedef paludis::WrappedForwardIterator<ChannelIteratorTag, Channel::ptr const> ChannelIterator;
@@ -58,9 +69,9 @@ namespace eir
                                         const std::pair<const std::string, Value> > SettingsIterator;
             SettingsIterator begin_settings();
             SettingsIterator end_settings();
-            SettingsIterator find_setting(std::string name);
-            Value get_setting(std::string name);
-            Value get_setting_with_default(std::string name, std::string _default);
+            SettingsIterator find_setting(const std::string& name);
+            const Value& get_setting(const std::string& name);
+            Value get_setting_with_default(const std::string& name, std::string _default);
             std::pair<SettingsIterator, bool> add_setting(std::string n, Value v);
             unsigned long remove_setting(std::string n);
             void remove_setting(SettingsIterator it);
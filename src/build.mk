@@ -1,6 +1,7 @@
 EXECUTABLES = eir
 
-eir_SOURCES = bot.cpp \
+eir_SOURCES = attributes.cpp \
+	    bot.cpp \
 	    bot_command.cpp \
 	    capability.cpp \
 	    client.cpp \
@@ -10,6 +11,7 @@ eir_SOURCES = bot.cpp \
 	    logger.cpp \
 	    main.cpp \
 	    match.cpp \
+	    memory.cpp \
 	    message.cpp \
 	    modload.cpp \
 	    modules.cpp \
@@ -20,6 +22,7 @@ eir_SOURCES = bot.cpp \
 	    string_util.cpp \
 	    supported.cpp \
 	    value.cpp \
+	    value_binary.cpp \
 
 eir_LDFLAGS = -Wl,-export-dynamic -Wl,-rpath,$(LIBDIR)
-eir_LIBRARIES = -ldl paludis/util/paludisutil
+eir_LIBRARIES = -ldl -lpthread paludis/util/paludisutil
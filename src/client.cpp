@@ -5,19 +5,106 @@
 
 #include <map>
 #include <set>
+#include <iterator>
+#include <algorithm>
 
 #include <paludis/util/wrapped_forward_iterator-impl.hh>
 #include <paludis/util/member_iterator-impl.hh>
 #include <paludis/util/private_implementation_pattern-impl.hh>
 
 #include "string_util.h"
+#include "pool_allocator.h"
+#include "memory.h"
 
 using namespace eir;
 
+namespace
+{
+    unsigned long attribute_bytes(const AttributeSet &attrs)
+    {
+        unsigned long bytes = attrs.heap_bytes();
+        for (AttributeSet::const_iterator it = attrs.begin(); it != attrs.end(); ++it)
+            bytes += memory::value_usage(it->second).bytes - sizeof(Value);
+        return bytes;
+    }
+}
+
+namespace eir
+{
+    // One side of the membership graph: either a client's channels or a channel's members.
+    struct MembershipList
+    {
+        Membership *first, *last;
+        std::size_t count;
+        bool client_side;
+
+        MembershipList(bool c) : first(0), last(0), count(0), client_side(c)
+        { }
+
+        Membership *& prev(Membership *m) const { return client_side ? m->client_prev : m->channel_prev; }
+        Membership *& next(Membership *m) const { return client_side ? m->client_next : m->channel_next; }
+        bool & on(Membership *m) const { return client_side ? m->on_client : m->on_channel; }
+
+        bool contains(const Membership *m) const { return client_side ? m->on_client : m->on_channel; }
+
+        void push_back(Membership *m)
+        {
+            prev(m) = last;
+            next(m) = 0;
+            if (last)
+                next(last) = m;
+            else
+                first = m;
+            last = m;
+            on(m) = true;
+            ++count;
+        }
+
+        // The membership may be destroyed by this, if it's now on neither list.
+        void unlink(Membership *m)
+        {
+            if (prev(m))
+                next(prev(m)) = next(m);
+            else
+                first = next(m);
+            if (next(m))
+                prev(next(m)) = prev(m);
+            else
+                last = prev(m);
+            prev(m) = next(m) = 0;
+            on(m) = false;
+            --count;
+
+            Membership::ptr keep;
+            if (!m->on_client && !m->on_channel)
+                keep.swap(m->self);
+        }
+
+        struct iterator : std::iterator<std::forward_iterator_tag, const Membership::ptr>
+        {
+            Membership *m;
+            bool client_side;
+
+            iterator(Membership *mm, bool c) : m(mm), client_side(c) { }
+
+            const Membership::ptr & operator* () const { return m->self; }
+            const Membership::ptr * operator-> () const { return &m->self; }
+            iterator & operator++ () { m = client_side ? m->client_next : m->channel_next; return *this; }
+            iterator operator++ (int) { iterator r(*this); ++*this; return r; }
+            bool operator== (const iterator &o) const { return m == o.m; }
+            bool operator!= (const iterator &o) const { return m != o.m; }
+        };
+
+        iterator begin() const { return iterator(first, client_side); }
+        iterator end() const { return iterator(0, client_side); }
+        iterator at(Membership *m) const { return iterator(m, client_side); }
+    };
+}
+
 template class paludis::WrappedForwardIterator<eir::Client::ChannelIteratorTag, eir::Membership::ptr const>;
 template class paludis::WrappedForwardIterator<eir::Channel::MemberIteratorTag, eir::Membership::ptr const>;
-template class paludis::WrappedForwardIterator<eir::Client::AttributeIteratorTag, std::pair<const std::string, eir::Value> >;
-template class paludis::WrappedForwardIterator<eir::Channel::AttributeIteratorTag, std::pair<const std::string, eir::Value> >;
+template class paludis::WrappedForwardIterator<eir::Client::AttributeIteratorTag, const std::pair<eir::AttributeSlot, eir::Value> >;
+template class paludis::WrappedForwardIterator<eir::Channel::AttributeIteratorTag, const std::pair<eir::AttributeSlot, eir::Value> >;
 
 namespace paludis
 {
@@ -26,27 +113,121 @@ namespace paludis
     {
         Bot *bot;
 
+        Client::id_type id;
+
         std::string nick, user, host, account;
 
-        std::map<std::string, Value> attributes;
+        AttributeSet attributes;
 
-        std::map<std::string, Membership::ptr> channels;
+        MembershipList channels;
 
         PrivilegeSet privs;
 
         mutable std::string nuh_cache;
         mutable bool nuh_cached;
 
+        static Client::id_type next_id;
+
+        // What this client currently contributes to memory::clients.
+        unsigned long accounted;
+
+        void recount()
+        {
+            unsigned long bytes = sizeof(Client) + sizeof(*this)
+                + memory::string_heap_bytes(nick) + memory::string_heap_bytes(user)
+                + memory::string_heap_bytes(host) + memory::string_heap_bytes(account)
+                + memory::string_heap_bytes(nuh_cache) + attribute_bytes(attributes);
+            memory::adjust(memory::clients, 0, long(bytes) - long(accounted));
+            accounted = bytes;
+        }
+
         Implementation(Bot *b, std::string n, std::string u, std::string h)
-            : bot(b), nick(n), user(u), host(h), nuh_cached(false)
-        { }
+            : bot(b), id(++next_id), nick(n), user(u), host(h), channels(true), nuh_cached(false),
+              accounted(0)
+        {
+            memory::adjust(memory::clients, 1, 0);
+            recount();
+        }
+
+        ~Implementation()
+        {
+            memory::adjust(memory::clients, -1, -long(accounted));
+        }
+    };
+
+    template <>
+    struct Implementation<Channel>
+    {
+        Bot *bot;
+
+        std::string name;
+
+        AttributeSet attributes;
+
+        MembershipList members;
+
+        unsigned int mode_counts[Membership::max_modes];
+
+        void count_modes(uint64_t bits, int delta)
+        {
+            for (int i = 0; bits; ++i, bits >>= 1)
+                if (bits & 1)
+                    mode_counts[i] += delta;
+        }
+
+        unsigned long accounted;
+
+        void recount()
+        {
+            unsigned long bytes = sizeof(Channel) + sizeof(*this)
+                + memory::string_heap_bytes(name) + attribute_bytes(attributes);
+            memory::adjust(memory::channels, 0, long(bytes) - long(accounted));
+            accounted = bytes;
+        }
+
+        Implementation(Bot *b, std::string n) : bot(b), name(n), members(false), accounted(0)
+        {
+            std::fill(mode_counts, mode_counts + Membership::max_modes, 0);
+            memory::adjust(memory::channels, 1, 0);
+            recount();
+        }
+
+        ~Implementation()
+        {
+            memory::adjust(memory::channels, -1, -long(accounted));
+        }
     };
 }
 
+Client::id_type paludis::Implementation<Client>::next_id = 0;
+
+namespace
+{
+    // Walk whichever of the two lists is shorter.
+    Membership *find_link(const MembershipList &channels, const Client *cl,
+                          const MembershipList &members, const Channel *ch)
+    {
+        if (channels.count <= members.count)
+        {
+            for (MembershipList::iterator it = channels.begin(); it != channels.end(); ++it)
+                if ((*it)->channel.get() == ch)
+                    return it.m;
+        }
+        else
+        {
+            for (MembershipList::iterator it = members.begin(); it != members.end(); ++it)
+                if ((*it)->client.get() == cl)
+                    return it.m;
+        }
+        return 0;
+    }
+}
+
 const std::string& Client::nick() const { return _imp->nick; }
 const std::string& Client::user() const { return _imp->user; }
 const std::string& Client::host() const { return _imp->host; }
 const std::string& Client::account() const { return _imp->account; }
+Client::id_type Client::id() const { return _imp->id; }
 
 const std::string& Client::nuh() const
 {
@@ -61,24 +242,20 @@ const std::string& Client::nuh() const
 
 void Client::change_nick(std::string newnick)
 {
-    // The correct logic for this is somewhat non-trivial, due to the various
-    // objects that index client objects by nickname. These all need to be
-    // properly updated.
-    //
-    // So, three stages. Remove the old nickname from all such indices, then
-    // change the nickname, then re-add the new nickname.
-    for (auto it = _imp->channels.begin(); it != _imp->channels.end(); ++it)
-        it->second->channel->remove_member(it->second);
-
-    _imp->bot->remove_client(shared_from_this());
+    // Memberships aren't indexed by nickname, so only the bot's client map
+    // needs to be updated.
+    std::string oldnick = _imp->nick;
 
     _imp->nick = newnick;
     _imp->nuh_cached = false;
+    _imp->recount();
 
-    _imp->bot->add_client(shared_from_this());
+    _imp->bot->rename_client(shared_from_this(), oldnick);
 
-    for (auto it = _imp->channels.begin(); it != _imp->channels.end(); ++it)
-        it->second->channel->add_member(it->second);
+    Message m(_imp->bot, "nick_changed", sourceinfo::Internal, shared_from_this());
+    m.args.push_back(oldnick);
+    m.args.push_back(newnick);
+    CommandRegistry::get_instance()->dispatch(&m);
 }
 
 void Client::set_account(std::string accountname)
@@ -91,8 +268,29 @@ void Client::set_account(std::string accountname)
     if (accountname == _imp->account)
         return;
 
+    _imp->bot->unindex_client(shared_from_this());
     _imp->account = accountname;
-    dispatch_internal_message(_imp->bot, "recalculate_privileges");
+    _imp->recount();
+    _imp->bot->index_client(shared_from_this());
+
+    Message m(_imp->bot, "account_changed", sourceinfo::Internal, shared_from_this());
+    CommandRegistry::get_instance()->dispatch(&m);
+}
+
+void Client::set_userhost(std::string newuser, std::string newhost)
+{
+    if (newuser == _imp->user && newhost == _imp->host)
+        return;
+
+    _imp->bot->unindex_client(shared_from_this());
+    _imp->user = newuser;
+    _imp->host = newhost;
+    _imp->nuh_cached = false;
+    _imp->recount();
+    _imp->bot->index_client(shared_from_this());
+
+    Message m(_imp->bot, "host_changed", sourceinfo::Internal, shared_from_this());
+    CommandRegistry::get_instance()->dispatch(&m);
 }
 
 Client::AttributeIterator Client::attr_begin()
@@ -105,51 +303,86 @@ Client::AttributeIterator Client::attr_end()
     return _imp->attributes.end();
 }
 
-Value Client::attr(const std::string &name)
+const Value & Client::attr(const std::string &name) const
 {
-    return _imp->attributes[name];
+    AttributeSlot slot;
+    if (!find_attribute_slot(name, slot))
+        return AttributeSet::empty_value();
+    return _imp->attributes.get(slot);
+}
+
+const Value & Client::attr(AttributeSlot slot) const
+{
+    return _imp->attributes.get(slot);
+}
+
+const Value * Client::find_attr(AttributeSlot slot) const
+{
+    return _imp->attributes.find(slot);
 }
 
 void Client::set_attr(const std::string &name, const Value &value)
 {
-    _imp->attributes[name] = value;
+    _imp->attributes.set(attribute_slot(name), value);
+    _imp->recount();
+}
+
+void Client::set_attr(AttributeSlot slot, const Value &value)
+{
+    _imp->attributes.set(slot, value);
+    _imp->recount();
+}
+
+bool Client::remove_attr(AttributeSlot slot)
+{
+    bool ret = _imp->attributes.erase(slot);
+    _imp->recount();
+    return ret;
 }
 
 Client::ChannelIterator Client::begin_channels()
 {
-    return second_iterator(_imp->channels.begin());
+    return _imp->channels.begin();
 }
 
 Client::ChannelIterator Client::end_channels()
 {
-    return second_iterator(_imp->channels.end());
+    return _imp->channels.end();
 }
 
 Membership::ptr Client::find_membership(std::string chname)
 {
-    std::map<std::string, Membership::ptr>::iterator it = _imp->channels.find(chname);
-    if (it == _imp->channels.end())
+    Channel::ptr ch = _imp->bot->find_channel(chname);
+    if (!ch)
         return Membership::ptr();
-    return it->second;
+    Membership *m = find_link(_imp->channels, this, ch->_imp->members, ch.get());
+    return m ? m->self : Membership::ptr();
+}
+
+const Membership::ptr Client::find_membership(std::string chname) const
+{
+    return const_cast<Client *>(this)->find_membership(chname);
 }
 
 Client::ChannelIterator Client::find_membership_it(std::string chname)
 {
-    return second_iterator(_imp->channels.find(chname));
+    Channel::ptr ch = _imp->bot->find_channel(chname);
+    if (!ch)
+        return end_channels();
+    return _imp->channels.at(find_link(_imp->channels, this, ch->_imp->members, ch.get()));
 }
 
 Membership::ptr Client::join_chan(Channel::ptr c)
 {
     Context ctx("Adding client " + _imp->nick + " to channel " + c->name());
-    Membership::ptr m;
 
-    if (m = find_membership(c->name()))
-        return m;
+    if (Membership *existing = find_link(_imp->channels, this, c->_imp->members, c.get()))
+        return existing->self;
 
-    m.reset(new Membership(shared_from_this(), c));
+    Membership::ptr m = std::allocate_shared<Membership>(PoolAllocator<Membership>(), shared_from_this(), c);
 
     if(c->add_member(m))
-        _imp->channels.insert(make_pair(c->name(), m));
+        _imp->channels.push_back(m.get());
 
     return m;
 }
@@ -157,9 +390,9 @@ Membership::ptr Client::join_chan(Channel::ptr c)
 void Client::leave_chan(Channel::ptr c)
 {
     Context ctx("Removing client " + _imp->nick + "from channel " + c->name());
-    Membership::ptr m = find_membership(c->name());
+    Membership *m = find_link(_imp->channels, this, c->_imp->members, c.get());
     if (m)
-        leave_chan(m);
+        leave_chan(m->self);
 }
 
 void Client::leave_chan(Membership::ptr m)
@@ -168,7 +401,8 @@ void Client::leave_chan(Membership::ptr m)
         return;
 
     m->channel->remove_member(m);
-    _imp->channels.erase(m->channel->name());
+    if (m->on_client)
+        _imp->channels.unlink(m.get());
 }
 
 PrivilegeSet& Client::privs()
@@ -185,34 +419,6 @@ Client::~Client()
 {
 }
 
-namespace
-{
-    struct ClientComparator
-    {
-        int operator()(Client::ptr l, Client::ptr r)
-        {
-            return l->nick().compare(r->nick());
-        }
-    };
-}
-
-namespace paludis
-{
-    template <>
-    struct Implementation<Channel>
-    {
-        std::string name;
-
-        std::map<std::string, Value> attributes;
-
-        typedef std::map<std::string, Membership::ptr>::iterator MemberIterator;
-        std::map<std::string, Membership::ptr> members;
-
-        Implementation(std::string n) : name(n)
-        { }
-    };
-}
-
 const std::string& Channel::name()
 {
     return _imp->name;
@@ -220,35 +426,60 @@ const std::string& Channel::name()
 
 Channel::MemberIterator Channel::begin_members()
 {
-    return second_iterator(_imp->members.begin());
+    return _imp->members.begin();
 }
 
 Channel::MemberIterator Channel::end_members()
 {
-    return second_iterator(_imp->members.end());
+    return _imp->members.end();
 }
 
 Channel::MemberIterator Channel::find_member_it(std::string nick)
 {
-    return second_iterator(_imp->members.find(nick));
+    Membership::ptr m = find_member(nick);
+    return _imp->members.at(m.get());
 }
 
 MembershipPtr Channel::find_member(std::string nick)
 {
-    std::map<std::string, Membership::ptr>::iterator it = _imp->members.find(nick);
-    if (it == _imp->members.end())
+    Client::ptr c = _imp->bot->find_client(nick);
+    if (!c)
         return Membership::ptr();
-    return it->second;
+    Membership *m = find_link(c->_imp->channels, c.get(), _imp->members, this);
+    return m ? m->self : Membership::ptr();
 }
 
 bool Channel::add_member(Membership::ptr m)
 {
-    return _imp->members.insert(std::make_pair(m->client->nick(), m)).second;
+    if (m->channel.get() != this || m->on_channel)
+        return false;
+
+    if (!m->self)
+        m->self = m;
+    _imp->members.push_back(m.get());
+    _imp->count_modes(m->mode_bits, 1);
+    return true;
 }
 
 bool Channel::remove_member(Membership::ptr m)
 {
-    return _imp->members.erase(m->client->nick()) != 0;
+    if (m->channel.get() != this || !m->on_channel)
+        return false;
+
+    _imp->count_modes(m->mode_bits, -1);
+    _imp->members.unlink(m.get());
+    return true;
+}
+
+unsigned int Channel::member_count()
+{
+    return _imp->members.count;
+}
+
+unsigned int Channel::mode_count(char m)
+{
+    int i = Membership::mode_index(m);
+    return i < 0 ? 0 : _imp->mode_counts[i];
 }
 
 Channel::AttributeIterator Channel::attr_begin()
@@ -261,21 +492,109 @@ Channel::AttributeIterator Channel::attr_end()
     return _imp->attributes.end();
 }
 
-Value Channel::attr(const std::string &name)
+const Value & Channel::attr(const std::string &name) const
+{
+    AttributeSlot slot;
+    if (!find_attribute_slot(name, slot))
+        return AttributeSet::empty_value();
+    return _imp->attributes.get(slot);
+}
+
+const Value & Channel::attr(AttributeSlot slot) const
 {
-    return _imp->attributes[name];
+    return _imp->attributes.get(slot);
+}
+
+const Value * Channel::find_attr(AttributeSlot slot) const
+{
+    return _imp->attributes.find(slot);
 }
 
 void Channel::set_attr(const std::string &name, const Value &value)
 {
-    _imp->attributes[name] = value;
+    _imp->attributes.set(attribute_slot(name), value);
+    _imp->recount();
+}
+
+void Channel::set_attr(AttributeSlot slot, const Value &value)
+{
+    _imp->attributes.set(slot, value);
+    _imp->recount();
+}
+
+bool Channel::remove_attr(AttributeSlot slot)
+{
+    bool ret = _imp->attributes.erase(slot);
+    _imp->recount();
+    return ret;
 }
 
-Channel::Channel(std::string n)
-    : paludis::PrivateImplementationPattern<Channel>(new paludis::Implementation<Channel>(n))
+Channel::Channel(Bot *b, std::string n)
+    : paludis::PrivateImplementationPattern<Channel>(new paludis::Implementation<Channel>(b, n))
 {
 }
 
 Channel::~Channel()
 {
 }
+
+void Membership::add_mode(char m)
+{
+    int i = mode_index(m);
+    if (i < 0 || has_mode(m))
+        return;
+
+    mode_bits |= uint64_t(1) << i;
+    if (on_channel)
+        channel->_imp->mode_counts[i]++;
+}
+
+void Membership::remove_mode(char m)
+{
+    int i = mode_index(m);
+    if (i < 0 || !has_mode(m))
+        return;
+
+    mode_bits &= ~(uint64_t(1) << i);
+    if (on_channel)
+        channel->_imp->mode_counts[i]--;
+}
+
+// Modes come out in the server's PREFIX order, highest first. Any the server
+// no longer lists as prefixes follow in alphabetical order.
+std::string Membership::modes() const
+{
+    std::string ret, prefix_modes = channel->_imp->bot->supported()->prefix_modes();
+    uint64_t rest = mode_bits;
+
+    for (std::string::iterator it = prefix_modes.begin(); it != prefix_modes.end(); ++it)
+    {
+        if (has_mode(*it))
+        {
+            ret += *it;
+            rest &= ~(uint64_t(1) << mode_index(*it));
+        }
+    }
+
+    for (char c = 'a'; rest && c <= 'z'; ++c)
+        if (rest & (uint64_t(1) << mode_index(c)))
+            ret += c;
+    for (char c = 'A'; rest && c <= 'Z'; ++c)
+        if (rest & (uint64_t(1) << mode_index(c)))
+            ret += c;
+    return ret;
+}
+
+Membership::Membership(Client::ptr cl, Channel::ptr ch)
+    : client(cl), channel(ch), mode_bits(0),
+      client_prev(0), client_next(0), channel_prev(0), channel_next(0),
+      on_client(false), on_channel(false)
+{
+    // Allocated together with its shared_ptr control block.
+    memory::adjust(memory::memberships, 1, sizeof(Membership) + 2 * sizeof(void *));
+}
+
+Membership::~Membership()
+{
+    memory::adjust(memory::memberships, -1, -long(sizeof(Membership) + 2 * sizeof(void *)));
+}
@@ -3,9 +3,11 @@
 
 #include "privilege.h"
 #include "value.h"
+#include "attributes.h"
 
 #include <string>
 #include <memory>
+#include <cstdint>
 
 #include <paludis/util/private_implementation_pattern.hh>
 #include <paludis/util/wrapped_forward_iterator.hh>
@@ -31,18 +33,29 @@ namespace eir
         const std::string& nuh() const;
         const std::string& account() const;
 
+        // Unique for the life of the process, and unaffected by nick changes.
+        typedef uint32_t id_type;
+        id_type id() const;
+
         void change_nick(std::string newnick);
         void set_account(std::string accountname);
+        void set_userhost(std::string newuser, std::string newhost);
 
         struct AttributeIteratorTag;
         typedef paludis::WrappedForwardIterator<AttributeIteratorTag,
-                        std::pair<const std::string, Value> > AttributeIterator;
+                        const std::pair<AttributeSlot, Value> > AttributeIterator;
 
         AttributeIterator attr_begin();
         AttributeIterator attr_end();
 
-        Value attr(const std::string &);
+        // Unset attributes read as an empty Value. Changes go through set_attr,
+        // which keeps the memory statistics up to date.
+        const Value & attr(const std::string &) const;
+        const Value & attr(AttributeSlot) const;
+        const Value * find_attr(AttributeSlot) const;
         void set_attr(const std::string &, const Value &);
+        void set_attr(AttributeSlot, const Value &);
+        bool remove_attr(AttributeSlot);
 
         Client(Bot *, std::string, std::string, std::string);
         ~Client();
@@ -62,6 +75,9 @@ namespace eir
         PrivilegeSet& privs();
 
         typedef std::shared_ptr<Client> ptr;
+
+        private:
+            friend struct Channel;
     };
 
     struct Channel : private paludis::PrivateImplementationPattern<Channel>,
@@ -80,20 +96,34 @@ namespace eir
         bool add_member(MembershipPtr);
         bool remove_member(MembershipPtr);
 
+        unsigned int member_count();
+        // Number of members with the given prefix mode; kept up to date as modes change.
+        unsigned int mode_count(char m);
+
         struct AttributeIteratorTag;
         typedef paludis::WrappedForwardIterator<AttributeIteratorTag,
-                        std::pair<const std::string, Value> > AttributeIterator;
+                        const std::pair<AttributeSlot, Value> > AttributeIterator;
 
         AttributeIterator attr_begin();
         AttributeIterator attr_end();
 
-        Value attr(const std::string &);
+        // Unset attributes read as an empty Value. Changes go through set_attr,
+        // which keeps the memory statistics up to date.
+        const Value & attr(const std::string &) const;
+        const Value & attr(AttributeSlot) const;
+        const Value * find_attr(AttributeSlot) const;
         void set_attr(const std::string &, const Value &);
+        void set_attr(AttributeSlot, const Value &);
+        bool remove_attr(AttributeSlot);
 
-        Channel(std::string);
+        Channel(Bot *, std::string);
         ~Channel();
 
         typedef std::shared_ptr<Channel> ptr;
+
+        private:
+            friend struct Client;
+            friend struct Membership;
     };
 
     struct Membership : private paludis::InstantiationPolicy<Membership, paludis::instantiation_method::NonCopyableTag>
@@ -101,15 +131,38 @@ namespace eir
         Client::ptr client;
         Channel::ptr channel;
 
-        std::string modes;
+        // Prefix modes are stored as a bitmask with one bit per mode letter.
+        static int mode_index(char m)
+        {
+            if (m >= 'a' && m <= 'z') return m - 'a';
+            if (m >= 'A' && m <= 'Z') return m - 'A' + 26;
+            return -1;
+        }
+        enum { max_modes = 52 };
 
-        bool has_mode(char m) { return modes.find(m) != std::string::npos; }
+        bool has_mode(char m) const { int i = mode_index(m); return i >= 0 && (mode_bits & (uint64_t(1) << i)); }
+        void add_mode(char m);
+        void remove_mode(char m);
+        std::string modes() const;
 
         typedef std::shared_ptr<Membership> ptr;
 
-        Membership(Client::ptr cl, Channel::ptr ch)
-            : client(cl), channel(ch)
-        { }
+        Membership(Client::ptr cl, Channel::ptr ch);
+        ~Membership();
+
+        private:
+            friend struct Client;
+            friend struct Channel;
+            friend struct MembershipList;
+
+            uint64_t mode_bits;
+
+            // Each membership is linked into both its client's channel list and its
+            // channel's member list, and keeps itself alive while it is on either.
+            Membership *client_prev, *client_next;
+            Membership *channel_prev, *channel_next;
+            bool on_client, on_channel;
+            ptr self;
     };
 }
 
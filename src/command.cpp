@@ -2,6 +2,7 @@
 #include "exceptions.h"
 #include "logger.h"
 #include "string_util.h"
+#include "memory.h"
 
 #include <paludis/util/instantiation_policy-impl.hh>
 #include <paludis/util/private_implementation_pattern-impl.hh>
@@ -35,6 +36,12 @@ namespace paludis
         typedef std::multimap<std::string, HandlerMapEntry> HandlerMap;
         std::vector<HandlerMap> _handlers;
 
+        // Approximate cost of one handler table entry: the map node and its key.
+        static long entry_bytes(const std::string &key)
+        {
+            return sizeof(HandlerMap::value_type) + 4 * sizeof(void *) + memory::string_heap_bytes(key);
+        }
+
         Implementation() : _handlers(3)
         {
         }
@@ -106,8 +113,10 @@ CommandRegistry::id CommandRegistry::add_handler(Filter f, const CommandRegistry
 
     next_id++;
 
-    _imp->_handlers[order].insert(std::make_pair(lowercase(f.command()),
+    std::string key = lowercase(f.command());
+    _imp->_handlers[order].insert(std::make_pair(key,
                                     HandlerMapEntry(CommandRegistry::id(next_id) ,f, h, quiet_errors)));
+    memory::adjust(memory::handlers, 1, Implementation<CommandRegistry>::entry_bytes(key));
     return id(next_id);
 }
 
@@ -120,6 +129,7 @@ void CommandRegistry::remove_handler(id h)
         {
             if (it->second.id == h)
             {
+                memory::adjust(memory::handlers, -1, -Implementation<CommandRegistry>::entry_bytes(it->first));
                 _imp->_handlers[i].erase(it);
                 break;
             }
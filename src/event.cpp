@@ -1,4 +1,10 @@
 #include "event_internal.h"
+#include "exceptions.h"
+
+#include <chrono>
+
+#include <unistd.h>
+#include <fcntl.h>
 
 using namespace eir;
 
@@ -10,20 +16,104 @@ EventManager *EventManager::get_instance()
 
 static EventManager::id next_id = 1;
 
+EventManagerImpl::EventManagerImpl()
+{
+    if (pipe(wakeup_pipe) < 0)
+        throw InternalError("Couldn't create event wakeup pipe");
+
+    for (int i = 0; i < 2; ++i)
+    {
+        fcntl(wakeup_pipe[i], F_SETFL, fcntl(wakeup_pipe[i], F_GETFL) | O_NONBLOCK);
+        fcntl(wakeup_pipe[i], F_SETFD, FD_CLOEXEC);
+    }
+}
+
+EventManagerImpl::~EventManagerImpl()
+{
+    close(wakeup_pipe[0]);
+    close(wakeup_pipe[1]);
+}
+
+void EventManagerImpl::post(EventManager::event_func f)
+{
+    bool was_empty;
+    {
+        std::lock_guard<std::mutex> guard(posted_lock);
+        was_empty = posted.empty();
+        posted.push_back(f);
+    }
+
+    // One byte in the pipe is enough to wake the loop for everything queued.
+    if (was_empty)
+    {
+        char c = 0;
+        if (write(wakeup_pipe[1], &c, 1) < 0)
+        {
+            // The pipe being full means a wakeup is already pending.
+        }
+    }
+}
+
+void EventManagerImpl::run_posted()
+{
+    std::vector<event_func> funcs;
+    {
+        std::lock_guard<std::mutex> guard(posted_lock);
+        funcs.swap(posted);
+
+        char buf[64];
+        while (read(wakeup_pipe[0], buf, sizeof buf) > 0)
+            ;
+    }
+
+    for (std::vector<event_func>::iterator it = funcs.begin(); it != funcs.end(); ++it)
+        (*it)();
+}
+
 EventManager::id EventManagerImpl::add_event(time_t t, EventManager::event_func f)
 {
-    event::ptr e(new event(next_id++, t, 0, f));
+    event::ptr e(new event(next_id++, t, 0, 0, f));
     events.push_back(e);
     return e->_id;
 }
 
-EventManager::id EventManagerImpl::add_recurring_event(time_t i, EventManager::event_func f)
+EventManager::id EventManagerImpl::add_recurring_event(time_t i, EventManager::event_func f, time_t slack)
 {
-    event::ptr e(new event(next_id++, time(NULL) + i, i, f));
+    event::ptr e(new event(next_id++, time(NULL) + i, i, slack, f));
+    e->next_time = coalesce(e->due_time, slack);
     events.push_back(e);
     return e->_id;
 }
 
+time_t EventManagerImpl::coalesce(time_t due, time_t slack) const
+{
+    if (slack <= 0)
+        return due;
+
+    // If something is already going to wake us up within the allowed window,
+    // go along with the earliest such wakeup.
+    time_t best = 0;
+    for (event_list::const_iterator it = events.begin(); it != events.end(); ++it)
+    {
+        time_t t = (*it)->next_time;
+        if (t >= due && t <= due + slack && (best == 0 || t < best))
+            best = t;
+    }
+    if (best)
+        return best;
+
+    // Otherwise round up to a multiple of the slack, so that unrelated events
+    // with similar slack tend to land on the same second.
+    return due + (slack - due % slack) % slack;
+}
+
+EventManager::id EventManagerImpl::add_idle_task(EventManager::idle_func f, unsigned int budget_ms)
+{
+    idle_task::ptr t(new idle_task(next_id++, budget_ms, f));
+    idle_tasks.push_back(t);
+    return t->_id;
+}
+
 void EventManagerImpl::remove_event(EventManager::id id)
 {
     event_list::iterator it = events.begin();
@@ -33,6 +123,17 @@ void EventManagerImpl::remove_event(EventManager::id id)
         if ((*it2)->_id ==  id)
             events.erase(it2);
     }
+
+    idle_task_list::iterator it3 = idle_tasks.begin();
+    while (it3 != idle_tasks.end())
+    {
+        idle_task_list::iterator it4 = it3++;
+        if ((*it4)->_id == id)
+        {
+            (*it4)->removed = true;
+            idle_tasks.erase(it4);
+        }
+    }
 }
 
 time_t EventManagerImpl::next_event_time() const
@@ -54,7 +155,10 @@ void EventManagerImpl::run_events()
             (*it)->func();
 
             if ((*it)->interval)
-                (*it)->next_time += (*it)->interval;
+            {
+                (*it)->due_time += (*it)->interval;
+                (*it)->next_time = coalesce((*it)->due_time, (*it)->slack);
+            }
             else
             {
                 events.erase(it++);
@@ -65,3 +169,42 @@ void EventManagerImpl::run_events()
     }
 }
 
+bool EventManagerImpl::have_idle_tasks() const
+{
+    return !idle_tasks.empty();
+}
+
+void EventManagerImpl::run_idle_tasks()
+{
+    typedef std::chrono::steady_clock clock;
+
+    // Work on a copy, as tasks are free to add or remove idle tasks (including
+    // themselves) while they run.
+    idle_task_list tasks(idle_tasks);
+
+    for (idle_task_list::iterator it = tasks.begin(); it != tasks.end(); ++it)
+    {
+        idle_task::ptr t = *it;
+        clock::time_point deadline = clock::now() + std::chrono::milliseconds(t->budget_ms);
+        bool more = true;
+
+        try
+        {
+            while (more && !t->removed)
+            {
+                more = t->func();
+                if (clock::now() >= deadline)
+                    break;
+            }
+        }
+        catch (...)
+        {
+            // Don't keep calling something that's broken.
+            remove_event(t->_id);
+            throw;
+        }
+
+        if (!more && !t->removed)
+            remove_event(t->_id);
+    }
+}
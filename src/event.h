@@ -13,10 +13,34 @@ namespace eir
             typedef unsigned int id;
 
             virtual id add_event(time_t t, event_func f) = 0;
-            virtual id add_recurring_event(time_t interval, event_func f) = 0;
+
+            /*
+             * If slack is non-zero, the event may be run up to that many seconds
+             * late, which lets the event manager run events with nearby deadlines
+             * from the same wakeup. Periodic maintenance should generally use some.
+             */
+            virtual id add_recurring_event(time_t interval, event_func f, time_t slack = 0) = 0;
+
+            /*
+             * Idle tasks are for deferred, low-priority work. The function should do
+             * one bounded chunk of work and return true if there is more left to do;
+             * it will be called repeatedly whenever the main loop has no pending input,
+             * for at most budget_ms milliseconds per loop iteration. Once it returns
+             * false, the task is removed. Idle tasks share the id space of events and
+             * are cancelled with remove_event().
+             */
+            typedef std::function<bool ()> idle_func;
+            virtual id add_idle_task(idle_func f, unsigned int budget_ms) = 0;
 
             virtual void remove_event(id) = 0;
 
+            /*
+             * The one member that may be called from any thread: queues f to be
+             * run by the main loop as soon as it can, waking it up if it's waiting.
+             * This is how work done on another thread hands its results back.
+             */
+            virtual void post(event_func f) = 0;
+
             static EventManager *get_instance();
     };
 }
@@ -1,6 +1,8 @@
 #include "event.h"
 #include <list>
 #include <memory>
+#include <mutex>
+#include <vector>
 
 namespace eir
 {
@@ -8,25 +10,61 @@ namespace eir
     {
         public:
             virtual id add_event(time_t t, event_func f);
-            virtual id add_recurring_event(time_t interval, event_func f);
+            virtual id add_recurring_event(time_t interval, event_func f, time_t slack = 0);
+            virtual id add_idle_task(idle_func f, unsigned int budget_ms);
 
             virtual void remove_event(id);
 
+            virtual void post(event_func f);
+
+            EventManagerImpl();
+            ~EventManagerImpl();
+
             time_t next_event_time() const;
             void run_events();
 
+            bool have_idle_tasks() const;
+            void run_idle_tasks();
+
+            // Readable whenever there are posted functions waiting to be run.
+            int wakeup_fd() const { return wakeup_pipe[0]; }
+            void run_posted();
+
         private:
             struct event {
                 id _id;
+                // due_time is when the event asked to be run; next_time is when
+                // it will actually be run, which may be up to slack seconds later.
+                time_t due_time;
                 time_t next_time;
                 time_t interval;
+                time_t slack;
                 event_func func;
-                event(id i, time_t t, time_t in, event_func f)
-                    : _id(i), next_time(t), interval(in), func(f)
+                event(id i, time_t t, time_t in, time_t sl, event_func f)
+                    : _id(i), due_time(t), next_time(t), interval(in), slack(sl), func(f)
                 { }
                 typedef std::shared_ptr<event> ptr;
             };
             typedef std::list<event::ptr> event_list;
             event_list events;
+
+            time_t coalesce(time_t due, time_t slack) const;
+
+            struct idle_task {
+                id _id;
+                unsigned int budget_ms;
+                idle_func func;
+                bool removed;
+                idle_task(id i, unsigned int b, idle_func f)
+                    : _id(i), budget_ms(b), func(f), removed(false)
+                { }
+                typedef std::shared_ptr<idle_task> ptr;
+            };
+            typedef std::list<idle_task::ptr> idle_task_list;
+            idle_task_list idle_tasks;
+
+            std::mutex posted_lock;
+            std::vector<event_func> posted;
+            int wakeup_pipe[2];
     };
 }
@@ -5,6 +5,7 @@
 #include "event.h"
 #include "logger.h"
 #include "storage.h"
+#include "memory.h"
 #include <functional>
 
 
@@ -29,10 +30,17 @@ namespace eir
         }
 
         template <class F_>
-        EventManager::id add_recurring_event(time_t t, F_ h)
+        EventManager::id add_recurring_event(time_t t, F_ h, time_t slack = 0)
         {
             return EventManager::get_instance()->add_recurring_event(t,
-                    std::bind(h, static_cast<T_*>(this)));
+                    std::bind(h, static_cast<T_*>(this)), slack);
+        }
+
+        template <class F_>
+        EventManager::id add_idle_task(F_ h, unsigned int budget_ms)
+        {
+            return EventManager::get_instance()->add_idle_task(
+                    std::bind(h, static_cast<T_*>(this)), budget_ms);
         }
     };
 
@@ -112,6 +120,25 @@ namespace eir
             ~StorageBackendHolder() { _release(); }
     };
 
+    class MemoryReporterHolder :
+        public paludis::InstantiationPolicy<MemoryReporterHolder, paludis::instantiation_method::NonCopyableTag>
+    {
+        private:
+            MemoryAccounting::ReporterId _id;
+
+            void _release() { if (_id) MemoryAccounting::get_instance()->remove_reporter(_id); _id = 0; }
+
+        public:
+            MemoryReporterHolder() : _id(0)
+            { }
+            MemoryReporterHolder(MemoryAccounting::ReporterId id) : _id(id)
+            { }
+            const MemoryReporterHolder & operator= (MemoryAccounting::ReporterId id)
+            { _release(); _id = id; return *this; }
+
+            ~MemoryReporterHolder() { _release(); }
+    };
+
     inline void dispatch_internal_message(Bot *b, std::string cmd)
     {
         Message m(b, cmd, sourceinfo::Internal);
@@ -2,22 +2,140 @@
 
 #include <paludis/util/private_implementation_pattern-impl.hh>
 #include <paludis/util/instantiation_policy-impl.hh>
+#include <paludis/util/stringify.hh>
 
 using namespace eir;
 using namespace paludis;
 
 #include <list>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
 
 template class paludis::InstantiationPolicy<Logger, paludis::instantiation_method::SingletonTag>;
 
 namespace
 {
+    /*
+     * A fixed-size lock-free queue (after Dmitry Vyukov's bounded MPMC queue).
+     * Each cell's sequence number says whether it's ready to be written to or
+     * read from at a given position, so producers and consumers only contend
+     * on the position they're claiming.
+     */
+    template <typename T_>
+    class BoundedQueue
+    {
+        private:
+            struct Cell
+            {
+                std::atomic<std::size_t> seq;
+                T_ data;
+            };
+
+            // The two positions are padded onto cache lines of their own, by hand
+            // because over-aligned types can't be allocated with new in C++11.
+            std::unique_ptr<Cell[]> _cells;
+            std::size_t _mask;
+            char _pad1[64];
+            std::atomic<std::size_t> _push_pos;
+            char _pad2[64 - sizeof(std::atomic<std::size_t>)];
+            std::atomic<std::size_t> _pop_pos;
+            char _pad3[64 - sizeof(std::atomic<std::size_t>)];
+
+        public:
+            // size must be a power of two.
+            BoundedQueue(std::size_t size)
+                : _cells(new Cell[size]), _mask(size - 1), _push_pos(0), _pop_pos(0)
+            {
+                for (std::size_t i = 0; i < size; ++i)
+                    _cells[i].seq.store(i, std::memory_order_relaxed);
+            }
+
+            bool push(T_ & value)
+            {
+                std::size_t pos = _push_pos.load(std::memory_order_relaxed);
+                Cell *cell;
+
+                while (true)
+                {
+                    cell = &_cells[pos & _mask];
+                    std::size_t seq = cell->seq.load(std::memory_order_acquire);
+                    std::ptrdiff_t diff = std::ptrdiff_t(seq) - std::ptrdiff_t(pos);
+
+                    if (diff == 0)
+                    {
+                        if (_push_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                            break;
+                    }
+                    else if (diff < 0)
+                        return false;
+                    else
+                        pos = _push_pos.load(std::memory_order_relaxed);
+                }
+
+                cell->data = std::move(value);
+                cell->seq.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+
+            bool pop(T_ & value)
+            {
+                std::size_t pos = _pop_pos.load(std::memory_order_relaxed);
+                Cell *cell;
+
+                while (true)
+                {
+                    cell = &_cells[pos & _mask];
+                    std::size_t seq = cell->seq.load(std::memory_order_acquire);
+                    std::ptrdiff_t diff = std::ptrdiff_t(seq) - std::ptrdiff_t(pos + 1);
+
+                    if (diff == 0)
+                    {
+                        if (_pop_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                            break;
+                    }
+                    else if (diff < 0)
+                        return false;
+                    else
+                        pos = _pop_pos.load(std::memory_order_relaxed);
+                }
+
+                value = std::move(cell->data);
+                cell->seq.store(pos + _mask + 1, std::memory_order_release);
+                return true;
+            }
+
+            bool empty() const
+            {
+                std::size_t pos = _pop_pos.load(std::memory_order_relaxed);
+                return _cells[pos & _mask].seq.load(std::memory_order_acquire) != pos + 1;
+            }
+    };
+
+    struct AsyncQueue
+    {
+        AsyncLogDestination *dest;
+        Logger::Overflow overflow;
+        BoundedQueue<std::string> records;
+        std::atomic<unsigned long> dropped;
+
+        AsyncQueue(AsyncLogDestination *d, Logger::Overflow o)
+            : dest(d), overflow(o), records(4096), dropped(0)
+        { }
+    };
+
     struct LogDestinationInfo
     {
         Logger::BackendId backend;
         Logger::DestinationId id;
         LogDestination *dest;
         Logger::Type typemask;
+        std::shared_ptr<AsyncQueue> queue;
         LogDestinationInfo(Logger::BackendId b, Logger::DestinationId i, LogDestination *d, Logger::Type t)
             : backend(b), id(i), dest(d), typemask(t)
         { }
@@ -41,6 +159,165 @@ namespace paludis
     {
         std::list<LogDestinationInfo> destinations;
         std::list<LogBackendInfo> backends;
+
+        // The union of every destination's typemask.
+        Logger::Type enabled_types;
+
+        void update_enabled_types()
+        {
+            enabled_types = 0;
+            for (std::list<LogDestinationInfo>::iterator it = destinations.begin(); it != destinations.end(); ++it)
+                enabled_types |= it->typemask;
+        }
+
+        // Asynchronous destinations are written by one thread, which holds
+        // writer_lock while it writes; it's also held to add or remove one.
+        // Records are pushed without it, and it's only taken to wake the writer
+        // if it's gone to sleep.
+        std::thread writer;
+        std::mutex writer_lock;
+        std::condition_variable wake_cond;
+        std::vector<std::shared_ptr<AsyncQueue> > queues;
+        std::atomic<bool> sleeping;
+        bool stopping;
+
+        Implementation()
+            : enabled_types(0), sleeping(false), stopping(false)
+        { }
+
+        ~Implementation()
+        {
+            {
+                std::lock_guard<std::mutex> guard(writer_lock);
+                stopping = true;
+                wake_cond.notify_one();
+            }
+            if (writer.joinable())
+                writer.join();
+        }
+
+        void wake_writer()
+        {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (sleeping.load())
+            {
+                std::lock_guard<std::mutex> guard(writer_lock);
+                wake_cond.notify_one();
+            }
+        }
+
+        void enqueue(AsyncQueue & q, std::string record)
+        {
+            if (!q.records.push(record))
+            {
+                switch (q.overflow)
+                {
+                    case Logger::Block:
+                        do
+                        {
+                            wake_writer();
+                            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                        }
+                        while (!q.records.push(record));
+                        break;
+
+                    case Logger::DropOldest:
+                        do
+                        {
+                            std::string discarded;
+                            if (q.records.pop(discarded))
+                                ++q.dropped;
+                        }
+                        while (!q.records.push(record));
+                        break;
+
+                    case Logger::DropNewest:
+                        ++q.dropped;
+                        break;
+                }
+            }
+
+            wake_writer();
+        }
+
+        // Called with writer_lock held. Returns whether there was anything to write.
+        bool drain(AsyncQueue & q, std::size_t limit)
+        {
+            std::string record;
+            std::size_t n = 0;
+
+            unsigned long dropped = q.dropped.exchange(0);
+            if (dropped)
+                q.dest->write(q.dest->format(NULL, NULL, "*** " + stringify(dropped) + " log records dropped"));
+
+            while (n < limit && q.records.pop(record))
+            {
+                q.dest->write(record);
+                ++n;
+            }
+
+            if (n || dropped)
+                q.dest->flush();
+
+            return n || dropped;
+        }
+
+        void write_loop()
+        {
+            std::unique_lock<std::mutex> lock(writer_lock);
+
+            while (true)
+            {
+                bool wrote = false;
+                for (std::vector<std::shared_ptr<AsyncQueue> >::iterator it = queues.begin(); it != queues.end(); ++it)
+                    wrote |= drain(**it, 256);
+
+                if (wrote)
+                    continue;
+
+                if (stopping)
+                    return;
+
+                sleeping.store(true);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+
+                bool idle = true;
+                for (std::vector<std::shared_ptr<AsyncQueue> >::iterator it = queues.begin(); it != queues.end(); ++it)
+                    if (!(*it)->records.empty() || (*it)->dropped.load())
+                        idle = false;
+
+                // Give destinations that hold output back a chance to write it.
+                if (idle && wake_cond.wait_for(lock, std::chrono::seconds(1)) == std::cv_status::timeout)
+                    for (std::vector<std::shared_ptr<AsyncQueue> >::iterator it = queues.begin(); it != queues.end(); ++it)
+                        (*it)->dest->flush();
+
+                sleeping.store(false);
+            }
+        }
+
+        void add_queue(std::shared_ptr<AsyncQueue> q)
+        {
+            std::lock_guard<std::mutex> guard(writer_lock);
+            queues.push_back(q);
+            if (!writer.joinable())
+                writer = std::thread(&Implementation<Logger>::write_loop, this);
+        }
+
+        // Writes out whatever's still queued, so that the destination can go.
+        void remove_queue(std::shared_ptr<AsyncQueue> q)
+        {
+            std::lock_guard<std::mutex> guard(writer_lock);
+            while (drain(*q, std::size_t(-1)))
+                ;
+            queues.erase(std::find(queues.begin(), queues.end(), q));
+        }
+
+        void remove(std::list<LogDestinationInfo>::iterator it)
+        {
+            if (it->queue)
+                remove_queue(it->queue);
+            delete it->dest;
+        }
     };
 }
 
@@ -59,12 +336,13 @@ void Logger::unregister_backend(BackendId id)
     {
         if (it->backend == id)
         {
-            delete it->dest;
+            _imp->remove(it);
             _imp->destinations.erase(it++);
         }
         else
             ++it;
     }
+    _imp->update_enabled_types();
 
     std::list<LogBackendInfo>::iterator it2 = _imp->backends.begin();
 
@@ -76,11 +354,11 @@ void Logger::unregister_backend(BackendId id)
             _imp->backends.erase(it2++);
         }
         else
-            ++it;
+            ++it2;
     }
 }
 
-Logger::DestinationId Logger::add_destination(std::string type, std::string arg, Type types)
+Logger::DestinationId Logger::add_destination(std::string type, std::string arg, Type types, Overflow overflow)
 {
     std::list<LogBackendInfo>::iterator backend = _imp->backends.begin(); 
 
@@ -99,6 +377,13 @@ Logger::DestinationId Logger::add_destination(std::string type, std::string arg,
 
     _imp->destinations.push_back(LogDestinationInfo(backend->id, ++next_id, d, types));
 
+    if (AsyncLogDestination *ad = dynamic_cast<AsyncLogDestination *>(d))
+    {
+        _imp->destinations.back().queue.reset(new AsyncQueue(ad, overflow));
+        _imp->add_queue(_imp->destinations.back().queue);
+    }
+    _imp->update_enabled_types();
+
     return next_id;
 }
 
@@ -109,20 +394,35 @@ void Logger::remove_destination(DestinationId id)
     while (it != _imp->destinations.end())
     {
         if (it->id == id)
+        {
+            _imp->remove(it);
             _imp->destinations.erase(it++);
+        }
         else
             ++it;
     }
+    _imp->update_enabled_types();
+}
+
+bool Logger::enabled(Type type) const
+{
+    return _imp->enabled_types & type;
 }
 
 void Logger::Log(Bot *bot, Client *source, Type type, std::string text)
 {
+    if (!(_imp->enabled_types & type))
+        return;
+
     for (std::list<LogDestinationInfo>::iterator it = _imp->destinations.begin();
             it != _imp->destinations.end(); ++it)
     {
         if (it->typemask & type)
         {
-            it->dest->Log(bot, source, text);
+            if (it->queue)
+                _imp->enqueue(*it->queue, it->queue->dest->format(bot, source, text));
+            else
+                it->dest->Log(bot, source, text);
         }
     }
 }
@@ -137,8 +437,9 @@ void Logger::clear_logs()
     for (std::list<LogDestinationInfo>::iterator it = _imp->destinations.begin();
             it != _imp->destinations.end(); it = _imp->destinations.erase(it))
     {
-        delete it->dest;
+        _imp->remove(it);
     }
+    _imp->update_enabled_types();
 }
 
 Logger::Logger()
@@ -172,6 +473,18 @@ namespace
             return Logger::Admin;
         return 0;
     }
+
+    Logger::Overflow OverflowFromString(std::string s)
+    {
+        if (s == "block")
+            return Logger::Block;
+        if (s == "drop_oldest")
+            return Logger::DropOldest;
+        if (s == "drop_newest")
+            return Logger::DropNewest;
+        throw eir::ConfigurationError("Unknown log overflow policy " + s);
+    }
+
     struct LogCreator : public CommandHandlerBase<LogCreator>
     {
         CommandHolder add_log_id, clear_log_id;
@@ -183,13 +496,17 @@ namespace
             std::string arg = *it++;
 
             Logger::Type types(0);
+            Logger::Overflow overflow(Logger::Block);
 
             for ( ; it != m->args.end(); ++it)
             {
-                types |= TypeFromString(*it);
+                if (it->compare(0, 9, "overflow=") == 0)
+                    overflow = OverflowFromString(it->substr(9));
+                else
+                    types |= TypeFromString(*it);
             }
 
-            Logger::get_instance()->add_destination(type, arg, types);
+            Logger::get_instance()->add_destination(type, arg, types, overflow);
         }
 
         void clear_logs(const Message *)
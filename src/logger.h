@@ -7,6 +7,7 @@
 #include <string>
 #include <functional>
 #include <memory>
+#include <type_traits>
 
 namespace eir
 {
@@ -20,6 +21,29 @@ namespace eir
             virtual ~LogDestination() { }
     };
 
+    /*
+     * A destination that's written by the logging thread rather than by the
+     * caller. format() runs on the calling thread, and shouldn't hold on to the
+     * Bot or Client, either of which may be NULL; write() gets what it returned
+     * later on, in order. flush() follows each batch of writes, and is also
+     * called about once a second while there's nothing to write, so it may
+     * keep output back for a while. Destroying the destination should write
+     * out anything it's kept.
+     */
+    class AsyncLogDestination : public LogDestination
+    {
+        public:
+            virtual std::string format(Bot *, Client *, const std::string &) = 0;
+            virtual void write(const std::string &) = 0;
+            virtual void flush() { }
+
+            void Log(Bot *b, Client *c, std::string text)
+            {
+                write(format(b, c, text));
+                flush();
+            }
+    };
+
     class LogBackend
     {
         public:
@@ -46,15 +70,46 @@ namespace eir
             };
             typedef unsigned int Type;
 
+            // What to do with a record for an asynchronous destination whose
+            // queue is full. Dropped records are counted, and the count logged.
+            enum Overflow
+            {
+                Block,
+                DropOldest,
+                DropNewest
+            };
+
             void Log(Bot *, Client *, Type, std::string);
             void Log(Bot *, std::shared_ptr<Client>, Type, std::string);
 
+            // Whether any destination wants records of the given type.
+            bool enabled(Type) const;
+
+            // These take a function returning the text, which is only called if
+            // something wants it; for call sites that would otherwise build a
+            // string for every line.
+            template <typename F_>
+            void Log(Bot *b, Client *c, Type t, F_ make_text,
+                     typename std::enable_if<!std::is_convertible<F_, std::string>::value>::type * = 0)
+            {
+                if (enabled(t))
+                    Log(b, c, t, std::string(make_text()));
+            }
+
+            template <typename F_>
+            void Log(Bot *b, std::shared_ptr<Client> c, Type t, F_ make_text,
+                     typename std::enable_if<!std::is_convertible<F_, std::string>::value>::type * = 0)
+            {
+                if (enabled(t))
+                    Log(b, c.get(), t, std::string(make_text()));
+            }
+
             typedef unsigned int BackendId;
             BackendId register_backend(std::string, LogBackend *);
             void unregister_backend(BackendId);
 
             typedef unsigned int DestinationId;
-            DestinationId add_destination(std::string type, std::string arg, Type types);
+            DestinationId add_destination(std::string type, std::string arg, Type types, Overflow overflow = Block);
             void remove_destination(DestinationId);
 
             void clear_logs();
@@ -0,0 +1,106 @@
+#include "memory.h"
+#include "settings.h"
+
+#include <paludis/util/private_implementation_pattern-impl.hh>
+#include <paludis/util/instantiation_policy-impl.hh>
+#include <paludis/util/wrapped_forward_iterator-impl.hh>
+
+#include <list>
+
+using namespace eir;
+using namespace paludis;
+
+template class paludis::InstantiationPolicy<MemoryAccounting, paludis::instantiation_method::SingletonTag>;
+
+namespace
+{
+    MemoryUsage counters[memory::n_counters];
+
+    const char *counter_names[memory::n_counters] = {
+        "clients",
+        "channels",
+        "memberships",
+        "handlers",
+        "send queues"
+    };
+
+    struct ReporterInfo
+    {
+        MemoryAccounting::ReporterId id;
+        std::string name;
+        MemoryAccounting::Reporter reporter;
+        ReporterInfo(MemoryAccounting::ReporterId i, std::string n, MemoryAccounting::Reporter r)
+            : id(i), name(n), reporter(r)
+        { }
+    };
+}
+
+void memory::adjust(memory::Counter c, long objects, long bytes)
+{
+    counters[c].objects += objects;
+    counters[c].bytes += bytes;
+}
+
+MemoryUsage memory::usage(memory::Counter c)
+{
+    return counters[c];
+}
+
+const char *memory::counter_name(memory::Counter c)
+{
+    return counter_names[c];
+}
+
+namespace paludis
+{
+    template <>
+    struct Implementation<MemoryAccounting>
+    {
+        std::list<ReporterInfo> reporters;
+    };
+}
+
+MemoryAccounting::ReporterId MemoryAccounting::add_reporter(std::string name, Reporter r)
+{
+    static ReporterId next_id = 0;
+    _imp->reporters.push_back(ReporterInfo(++next_id, name, r));
+    return next_id;
+}
+
+void MemoryAccounting::remove_reporter(ReporterId id)
+{
+    for (std::list<ReporterInfo>::iterator it = _imp->reporters.begin(); it != _imp->reporters.end(); ++it)
+    {
+        if (it->id == id)
+        {
+            _imp->reporters.erase(it);
+            return;
+        }
+    }
+}
+
+MemoryAccounting::Report MemoryAccounting::report()
+{
+    Report ret;
+
+    for (int c = 0; c < memory::n_counters; ++c)
+        ret.push_back(std::make_pair(std::string(counter_names[c]), counters[c]));
+
+    GlobalSettingsManager *settings = GlobalSettingsManager::get_instance();
+    for (GlobalSettingsManager::iterator it = settings->begin(); it != settings->end(); ++it)
+        ret.push_back(std::make_pair("settings " + it->first, memory::value_usage(it->second)));
+
+    for (std::list<ReporterInfo>::iterator it = _imp->reporters.begin(); it != _imp->reporters.end(); ++it)
+        ret.push_back(std::make_pair(it->name, it->reporter()));
+
+    return ret;
+}
+
+MemoryAccounting::MemoryAccounting()
+    : PrivateImplementationPattern<MemoryAccounting>(new Implementation<MemoryAccounting>)
+{
+}
+
+MemoryAccounting::~MemoryAccounting()
+{
+}
@@ -0,0 +1,82 @@
+#ifndef memory_h
+#define memory_h
+
+#include <paludis/util/private_implementation_pattern.hh>
+#include <paludis/util/instantiation_policy.hh>
+
+#include <string>
+#include <vector>
+#include <functional>
+
+namespace eir
+{
+    class Value;
+
+    struct MemoryUsage
+    {
+        unsigned long objects, bytes;
+
+        MemoryUsage(unsigned long o = 0, unsigned long b = 0)
+            : objects(o), bytes(b)
+        { }
+
+        MemoryUsage & operator+= (const MemoryUsage &o)
+        {
+            objects += o.objects;
+            bytes += o.bytes;
+            return *this;
+        }
+    };
+
+    namespace memory
+    {
+        // Running totals for the core's own objects, kept up to date by the objects
+        // themselves as they are created, changed and destroyed. These are plain
+        // counters so that they remain usable during static destruction.
+        enum Counter
+        {
+            clients,
+            channels,
+            memberships,
+            handlers,
+            send_queue,
+            n_counters
+        };
+
+        void adjust(Counter c, long objects, long bytes);
+        MemoryUsage usage(Counter c);
+        const char *counter_name(Counter c);
+
+        // Heap bytes owned by a string, beyond the string object itself.
+        inline unsigned long string_heap_bytes(const std::string &s)
+        {
+            // Anything within the small-string buffer doesn't allocate.
+            return s.capacity() > 15 ? s.capacity() + 1 : 0;
+        }
+
+        // Walks the whole tree; defined in value.cpp.
+        MemoryUsage value_usage(const Value &v);
+    }
+
+    class MemoryAccounting :
+        public paludis::InstantiationPolicy<MemoryAccounting, paludis::instantiation_method::SingletonTag>,
+        public paludis::PrivateImplementationPattern<MemoryAccounting>
+    {
+        public:
+            typedef std::function<MemoryUsage ()> Reporter;
+            typedef unsigned int ReporterId;
+
+            ReporterId add_reporter(std::string name, Reporter r);
+            void remove_reporter(ReporterId id);
+
+            typedef std::vector<std::pair<std::string, MemoryUsage> > Report;
+
+            // The core counters, then each global settings tree, then registered reporters.
+            Report report();
+
+            MemoryAccounting();
+            ~MemoryAccounting();
+    };
+}
+
+#endif
@@ -16,6 +16,9 @@ struct Modloader : public CommandHandlerBase<Modloader>
         }
 
         ModuleRegistry::get_instance()->load(m->args[0]);
+        // At startup, the bot waits for these once it's connecting.
+        if (m->source.type != sourceinfo::ConfigFile)
+            StorageManager::get_instance()->finish_loads();
         m->source.reply("Loaded " + m->args[0]);
 
         if (m->source.client)
@@ -49,6 +52,8 @@ struct Modloader : public CommandHandlerBase<Modloader>
             m->source.reply("Unloaded " + m->args[0]);
         }
         ModuleRegistry::get_instance()->load(m->args[0]);
+        if (m->source.type != sourceinfo::ConfigFile)
+            StorageManager::get_instance()->finish_loads();
         m->source.reply("Loaded " + m->args[0]);
 
         if (m->source.client)
@@ -1,4 +1,5 @@
 #include "modules.h"
+#include "storage.h"
 
 #include <paludis/util/instantiation_policy-impl.hh>
 #include <paludis/util/private_implementation_pattern-impl.hh>
@@ -108,6 +109,9 @@ bool ModuleRegistry::unload(std::string name)
     if (mod == _imp->modules.end())
         return false;
 
+    // Don't leave a load to call back into a module that's gone.
+    StorageManager::get_instance()->finish_loads();
+
     if (mod->obj)
         delete mod->obj;
     mod->obj = 0;
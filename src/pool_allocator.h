@@ -0,0 +1,125 @@
+#ifndef pool_allocator_h
+#define pool_allocator_h
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace eir
+{
+    /*
+     * A free-list allocator for objects of one size, carved out of large slabs.
+     * Slabs are never returned to the system; freed blocks are reused for the
+     * next allocation of the same size. Not thread-safe.
+     */
+    template <std::size_t Size_>
+    class FixedPool
+    {
+        private:
+            enum { block_size = (Size_ + 15) & ~std::size_t(15),
+                   blocks_per_slab = 256 };
+
+            struct free_block { free_block *next; };
+
+            free_block *_free;
+            std::vector<void *> _slabs;
+
+            void _grow()
+            {
+                char *slab = static_cast<char *>(::operator new(block_size * blocks_per_slab));
+                _slabs.push_back(slab);
+                for (std::size_t i = blocks_per_slab; i > 0; --i)
+                {
+                    free_block *b = reinterpret_cast<free_block *>(slab + (i - 1) * block_size);
+                    b->next = _free;
+                    _free = b;
+                }
+            }
+
+            FixedPool() : _free(0) { }
+            FixedPool(const FixedPool &);
+
+        public:
+            static FixedPool &get_instance()
+            {
+                static FixedPool *instance = new FixedPool;
+                return *instance;
+            }
+
+            void *allocate()
+            {
+                if (!_free)
+                    _grow();
+                free_block *b = _free;
+                _free = b->next;
+                return b;
+            }
+
+            void deallocate(void *p)
+            {
+                free_block *b = static_cast<free_block *>(p);
+                b->next = _free;
+                _free = b;
+            }
+
+            std::size_t slab_bytes() const
+            {
+                return _slabs.size() * block_size * blocks_per_slab;
+            }
+    };
+
+    /*
+     * Standard allocator interface over FixedPool, for use with std::allocate_shared
+     * and node-based containers. Single-object allocations come from the pool for
+     * that object's size; anything else goes to operator new.
+     */
+    template <class T_>
+    struct PoolAllocator
+    {
+        typedef T_ value_type;
+        typedef T_ *pointer;
+        typedef const T_ *const_pointer;
+        typedef T_ &reference;
+        typedef const T_ &const_reference;
+        typedef std::size_t size_type;
+        typedef std::ptrdiff_t difference_type;
+
+        template <class U_>
+        struct rebind { typedef PoolAllocator<U_> other; };
+
+        PoolAllocator() { }
+        template <class U_>
+        PoolAllocator(const PoolAllocator<U_> &) { }
+
+        T_ *allocate(std::size_t n, const void * = 0)
+        {
+            if (n == 1)
+                return static_cast<T_ *>(FixedPool<sizeof(T_)>::get_instance().allocate());
+            return static_cast<T_ *>(::operator new(n * sizeof(T_)));
+        }
+
+        void deallocate(T_ *p, std::size_t n)
+        {
+            if (n == 1)
+                FixedPool<sizeof(T_)>::get_instance().deallocate(p);
+            else
+                ::operator delete(p);
+        }
+
+        std::size_t max_size() const { return std::size_t(-1) / sizeof(T_); }
+
+        template <class U_, class... Args_>
+        void construct(U_ *p, Args_ &&... args) { ::new ((void *)p) U_(std::forward<Args_>(args)...); }
+
+        template <class U_>
+        void destroy(U_ *p) { p->~U_(); }
+    };
+
+    template <class T_, class U_>
+    inline bool operator== (const PoolAllocator<T_> &, const PoolAllocator<U_> &) { return true; }
+    template <class T_, class U_>
+    inline bool operator!= (const PoolAllocator<T_> &, const PoolAllocator<U_> &) { return false; }
+}
+
+#endif
@@ -2,10 +2,12 @@
 #include "exceptions.h"
 #include "event_internal.h"
 #include "logger.h"
+#include "memory.h"
 
 #include <paludis/util/private_implementation_pattern-impl.hh>
 
 #include <queue>
+#include <algorithm>
 #include <cstdlib>
 
 #include <unistd.h>
@@ -34,6 +36,23 @@ namespace paludis
 
         std::queue<std::string> _send_queue;
 
+        static long line_bytes(const std::string &l)
+        {
+            return sizeof(std::string) + memory::string_heap_bytes(l);
+        }
+
+        void queue_line(const std::string &l)
+        {
+            _send_queue.push(l);
+            memory::adjust(memory::send_queue, 1, line_bytes(_send_queue.back()));
+        }
+
+        void dequeue_line()
+        {
+            memory::adjust(memory::send_queue, -1, -line_bytes(_send_queue.front()));
+            _send_queue.pop();
+        }
+
         Server::Handler _handler;
         Bot *_bot;
 
@@ -57,6 +76,8 @@ namespace paludis
 
         ~Implementation()
         {
+            while (!_send_queue.empty())
+                dequeue_line();
         }
     };
 }
@@ -117,7 +138,7 @@ void Server::disconnect(std::string reason)
 void Server::purge()
 {
     while (! _imp->_send_queue.empty())
-        _imp->_send_queue.pop();
+        _imp->dequeue_line();
 }
 
 void Server::send(std::string line)
@@ -136,7 +157,7 @@ void Server::send(std::string line)
     }
     line += "\r\n";
 
-    _imp->_send_queue.push(line);
+    _imp->queue_line(line);
 
     _imp->maybe_send_stuff();
 }
@@ -147,7 +168,7 @@ void Implementation<Server>::maybe_send_stuff()
     {
         std::string line = _send_queue.front();
         write(socketfd, line.c_str(), line.size());
-        _send_queue.pop();
+        dequeue_line();
         ++cur_burst;
     }
 }
@@ -162,6 +183,7 @@ void Implementation<Server>::io_event()
 void Implementation<Server>::do_receive_stuff()
 {
     std::queue<std::string> recv_lines;
+    bool closed = false;
 
     while(true)
     {
@@ -169,7 +191,10 @@ void Implementation<Server>::do_receive_stuff()
         int r = read(socketfd, recvbuf + recvpos, bufsize - recvpos);
 
         if (r == 0)
+        {
+            closed = true;
             break;
+        }
         else if (r == -1)
         {
             error = errno;
@@ -208,6 +233,9 @@ void Implementation<Server>::do_receive_stuff()
         _handler(recv_lines.front());
         recv_lines.pop();
     }
+
+    if (closed)
+        throw DisconnectedException("Connection closed by server");
 }
 
 void Server::run()
@@ -222,6 +250,9 @@ void Implementation<Server>::run()
     EventManager::id _send_id = EventManager::get_instance()->add_recurring_event(rate_time,
                                     std::bind(&Implementation<Server>::io_event, this));
 
+    EventManagerImpl *events = static_cast<EventManagerImpl*>(EventManager::get_instance());
+    time_t last_idle_run = time(NULL);
+
     do_receive_stuff();
 
     while(true)
@@ -236,19 +267,32 @@ void Implementation<Server>::run()
         FD_SET(socketfd, &read);
         FD_SET(socketfd, &write);
         FD_SET(socketfd, &except);
+        FD_SET(events->wakeup_fd(), &read);
 
-        timeout.tv_sec = static_cast<EventManagerImpl*>(EventManager::get_instance())->next_event_time() - time(NULL);
+        timeout.tv_sec = events->next_event_time() - time(NULL);
 
-        if (timeout.tv_sec < 0)
+        // If there's deferred work waiting, only poll, so that it gets to run as
+        // soon as the socket goes quiet.
+        if (timeout.tv_sec < 0 || events->have_idle_tasks())
             timeout.tv_sec = 0;
 
-        select(1, &read, NULL, NULL, &timeout);
+        int ready = select(std::max(socketfd, events->wakeup_fd()) + 1, &read, NULL, NULL, &timeout);
 
         do_receive_stuff();
 
         try
         {
-            static_cast<EventManagerImpl*>(EventManager::get_instance())->run_events();
+            events->run_posted();
+            events->run_events();
+
+            // Idle tasks only get the loop when there's no input waiting to be
+            // handled -- unless they've been starved for a while, in which case
+            // let them have one turn anyway.
+            if (ready == 0 || time(NULL) - last_idle_run > 1)
+            {
+                last_idle_run = time(NULL);
+                events->run_idle_tasks();
+            }
         }
         catch (eir::Exception &e)
         {
@@ -31,17 +31,17 @@ GlobalSettingsManager::iterator GlobalSettingsManager::end()
     return _imp->_map.end();
 }
 
-GlobalSettingsManager::iterator GlobalSettingsManager::find(std::string name)
+GlobalSettingsManager::iterator GlobalSettingsManager::find(const std::string& name)
 {
     return _imp->_map.find(name);
 }
 
-Value& GlobalSettingsManager::get(std::string name)
+Value& GlobalSettingsManager::get(const std::string& name)
 {
     return _imp->_map[name];
 }
 
-Value GlobalSettingsManager::get_with_default(std::string name, Value _default)
+Value GlobalSettingsManager::get_with_default(const std::string& name, Value _default)
 {
     iterator it = find(name);
     if (it == end())
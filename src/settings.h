@@ -19,10 +19,10 @@ namespace eir
             iterator begin();
             iterator end();
 
-            iterator find(std::string name);
+            iterator find(const std::string& name);
 
-            Value& get(std::string name);
-            Value get_with_default(std::string name, Value _default);
+            Value& get(const std::string& name);
+            Value get_with_default(const std::string& name, Value _default);
 
             bool add(std::string n, Value v);
 
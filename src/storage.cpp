@@ -3,9 +3,25 @@
 
 #include <paludis/util/private_implementation_pattern-impl.hh>
 #include <paludis/util/instantiation_policy-impl.hh>
+#include <paludis/util/stringify.hh>
 
 #include <list>
-#include <set>
+#include <map>
+#include <memory>
+#include <algorithm>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdexcept>
+#include <new>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
 
 using namespace eir;
 using namespace paludis;
@@ -74,46 +90,350 @@ namespace paludis
 
         BackendData *default_backend;
 
-        std::set<std::pair<const Value *, std::string>> auto_saves;
+        // Saves are written by a single background thread, in the order they were
+        // queued. Each carries a copy of the value, which shares its contents
+        // until the main thread next modifies the original; copy-on-write then
+        // leaves the snapshot alone. Finished jobs are handed back to the main
+        // loop, so that their callbacks run there and the snapshots are released
+        // there too.
+        struct WriteJob
+        {
+            Value snapshot;
+            StorageBackend *backend;
+            std::string target;
+            bool failed;
+            std::string error;
+            std::function<void (const WriteJob &)> done;
+        };
+
+        std::thread writer;
+        std::mutex queue_lock;
+        std::condition_variable queue_cond, idle_cond;
+        std::deque<WriteJob> queued;
+        std::vector<WriteJob> finished;
+        bool writing, stopping;
+
+        void queue_save(const Value & v, const std::string & dest, std::function<void (const WriteJob &)> done)
+        {
+            std::string type, target;
+            split_storage_dest(dest, type, target);
 
-        void do_auto_save(const Value *v, std::string dest)
+            BackendList::iterator it = find_by_type(type);
+
+            if (it == backends.end())
+                throw StorageError("No such storage type '" + type + "' has been loaded");
+
+            WriteJob job;
+            job.snapshot = v;
+            job.backend = it->be;
+            job.target = target;
+            job.failed = false;
+            job.done = done;
+
+            std::lock_guard<std::mutex> guard(queue_lock);
+            if (!writer.joinable())
+                writer = std::thread(&Implementation<StorageManager>::write_loop, this);
+            queued.push_back(std::move(job));
+            queue_cond.notify_one();
+        }
+
+        void write_loop()
         {
-            auto_saves.insert(make_pair(v, dest));
+            std::unique_lock<std::mutex> lock(queue_lock);
+
+            while (true)
+            {
+                queue_cond.wait(lock, [this] { return stopping || !queued.empty(); });
+
+                // When stopping, whatever is still queued gets written first.
+                if (queued.empty())
+                    return;
+
+                WriteJob job = std::move(queued.front());
+                queued.pop_front();
+                writing = true;
+                lock.unlock();
+
+                try
+                {
+                    job.backend->Save(job.snapshot, job.target);
+                }
+                catch (paludis::Exception & e)
+                {
+                    job.failed = true;
+                    job.error = e.message();
+                }
+                catch (std::exception & e)
+                {
+                    job.failed = true;
+                    job.error = e.what();
+                }
+
+                lock.lock();
+                writing = false;
+                finished.push_back(std::move(job));
+                idle_cond.notify_all();
+
+                // Nothing will run the callbacks once we're being destroyed.
+                if (!stopping)
+                    EventManager::get_instance()->post(std::bind(&Implementation<StorageManager>::complete_writes, this));
+            }
         }
 
-        void do_auto_saves(const Message *)
+        void complete_writes()
+        {
+            std::vector<WriteJob> jobs;
+            {
+                std::lock_guard<std::mutex> guard(queue_lock);
+                jobs.swap(finished);
+            }
+
+            for (std::vector<WriteJob>::iterator it = jobs.begin(); it != jobs.end(); ++it)
+                if (it->done)
+                    it->done(*it);
+        }
+
+        void flush()
         {
-            for (auto it = auto_saves.begin(); it != auto_saves.end(); ++it)
             {
-                do_save(*it->first, it->second);
+                std::unique_lock<std::mutex> lock(queue_lock);
+                idle_cond.wait(lock, [this] { return queued.empty() && !writing; });
             }
+            complete_writes();
         }
 
-        void do_save(const eir::Value & v, std::string dest)
+        // Loads made with LoadAsync are run by a small pool of threads. Each job
+        // stays in pending_loads, in the order it was asked for, until its
+        // callback has been run on the main thread; only the main thread touches
+        // that list, while done is set by the loader under load_lock.
+        struct LoadJob
+        {
+            std::string source;
+            StorageBackend *backend;
+            std::string target;
+            StorageManager::LoadCallback loaded;
+            StorageManager::LoadErrorCallback failed;
+            Value result;
+            bool done, ok;
+            std::string error;
+        };
+
+        std::vector<std::thread> loaders;
+        std::mutex load_lock;
+        std::condition_variable load_cond, loaded_cond;
+        bool loaders_stopping;
+        std::deque<std::shared_ptr<LoadJob> > load_queue;
+        std::deque<std::shared_ptr<LoadJob> > pending_loads;
+
+        void queue_load(const std::string & source, StorageManager::LoadCallback loaded,
+                        StorageManager::LoadErrorCallback failed)
         {
-            std::string type, destination;
-            split_storage_dest(dest, type, destination);
+            std::string type, target;
+            split_storage_dest(source, type, target);
 
             BackendList::iterator it = find_by_type(type);
 
             if (it == backends.end())
                 throw StorageError("No such storage type '" + type + "' has been loaded");
 
-            it->be->Save(v, destination);
+            std::shared_ptr<LoadJob> job(new LoadJob);
+            job->source = source;
+            job->backend = it->be;
+            job->target = target;
+            job->loaded = loaded;
+            job->failed = failed;
+            job->done = job->ok = false;
+            pending_loads.push_back(job);
+
+            std::lock_guard<std::mutex> guard(load_lock);
+            unsigned pool_size = std::max(1u, std::min(4u, std::thread::hardware_concurrency()));
+            if (loaders.size() < pool_size)
+                loaders.push_back(std::thread(&Implementation<StorageManager>::load_loop, this));
+            load_queue.push_back(job);
+            load_cond.notify_one();
+        }
+
+        void load_loop()
+        {
+            std::unique_lock<std::mutex> lock(load_lock);
+
+            while (true)
+            {
+                load_cond.wait(lock, [this] { return loaders_stopping || !load_queue.empty(); });
+
+                if (loaders_stopping)
+                    return;
+
+                std::shared_ptr<LoadJob> job = load_queue.front();
+                load_queue.pop_front();
+                lock.unlock();
+
+                try
+                {
+                    job->result = job->backend->Load(job->target);
+                    job->ok = true;
+                }
+                catch (paludis::Exception & e)
+                {
+                    job->error = e.message();
+                }
+                catch (std::exception & e)
+                {
+                    job->error = e.what();
+                }
+
+                lock.lock();
+                job->done = true;
+                loaded_cond.notify_all();
+                if (!loaders_stopping)
+                    EventManager::get_instance()->post(std::bind(&Implementation<StorageManager>::complete_loads, this));
+            }
+        }
+
+        // Runs the callbacks of finished loads, in the order they were asked for.
+        void complete_loads()
+        {
+            while (!pending_loads.empty())
+            {
+                std::shared_ptr<LoadJob> job = pending_loads.front();
+                {
+                    std::lock_guard<std::mutex> guard(load_lock);
+                    if (!job->done)
+                        return;
+                }
+                pending_loads.pop_front();
+
+                if (job->ok)
+                    job->loaded(job->result);
+                else if (job->failed)
+                    job->failed(job->error);
+            }
+        }
+
+        void wait_for_loads()
+        {
+            std::unique_lock<std::mutex> lock(load_lock);
+            loaded_cond.wait(lock, [this] {
+                for (std::deque<std::shared_ptr<LoadJob> >::iterator it = pending_loads.begin(); it != pending_loads.end(); ++it)
+                    if (!(*it)->done)
+                        return false;
+                return true;
+            });
+        }
+
+        void finish_loads()
+        {
+            // A callback may itself start another load.
+            while (!pending_loads.empty())
+            {
+                wait_for_loads();
+                complete_loads();
+            }
+        }
+
+        bool load_pending(const std::string & source) const
+        {
+            for (std::deque<std::shared_ptr<LoadJob> >::const_iterator it = pending_loads.begin(); it != pending_loads.end(); ++it)
+                if ((*it)->source == source)
+                    return true;
+            return false;
+        }
+
+        // Each auto-saved value maps to its generation as of its last successful
+        // save, so that one which hasn't changed since isn't written out again.
+        typedef std::map<std::pair<const Value *, std::string>, unsigned long> AutoSaveMap;
+        AutoSaveMap auto_saves;
+        unsigned long saves_queued, saves_skipped;
+
+        void do_auto_save(const Value *v, std::string dest)
+        {
+            auto_saves.insert(make_pair(make_pair(v, dest), 0UL));
+        }
+
+        void auto_save_one(AutoSaveMap::iterator it)
+        {
+            unsigned long generation = it->first.first->generation();
+
+            if (generation != 0 && generation == it->second)
+            {
+                ++saves_skipped;
+                return;
+            }
+
+            std::string dest = it->first.second;
+
+            // Until it's been loaded, the value is only a placeholder.
+            if (load_pending(dest))
+                return;
+
+            try
+            {
+                queue_save(*it->first.first, dest, [it, generation, dest] (const WriteJob & job) {
+                    if (!job.failed)
+                        it->second = generation;
+                    else
+                        Logger::get_instance()->Log(NULL, NULL, Logger::Warning,
+                                "Couldn't save " + dest + ": " + job.error);
+                });
+                ++saves_queued;
+            }
+            catch (StorageError & e)
+            {
+                Logger::get_instance()->Log(NULL, NULL, Logger::Warning,
+                        "Couldn't save " + dest + ": " + e.message());
+            }
+        }
+
+        void start_auto_saves()
+        {
+            for (AutoSaveMap::iterator it = auto_saves.begin(); it != auto_saves.end(); ++it)
+                auto_save_one(it);
+
+            if (saves_queued || saves_skipped)
+                Logger::get_instance()->Log(NULL, NULL, Logger::Debug,
+                        "Auto-save: " + stringify(saves_queued) + " queued, " +
+                        stringify(saves_skipped) + " skipped as unchanged");
+            saves_queued = saves_skipped = 0;
+        }
+
+        void do_auto_saves(const Message *)
+        {
+            start_auto_saves();
+            flush();
         }
 
         EventHolder auto_save_event;
         CommandHolder shutdown_save_command;
 
         Implementation()
-            : default_backend(0)
+            : default_backend(0), writing(false), stopping(false), loaders_stopping(false),
+              saves_queued(0), saves_skipped(0)
         {
             auto_save_event = EventManager::get_instance()->add_recurring_event(120,
-                                std::bind(&Implementation<StorageManager>::do_auto_saves, this, (const Message *)0));
+                                std::bind(&Implementation<StorageManager>::start_auto_saves, this), 30);
             shutdown_save_command = CommandRegistry::get_instance()->add_handler(
                                 filter_command_type("shutting_down", sourceinfo::Internal),
                                 std::bind(&Implementation<StorageManager>::do_auto_saves, this, std::placeholders::_1));
         }
+
+        ~Implementation()
+        {
+            {
+                std::lock_guard<std::mutex> guard(queue_lock);
+                stopping = true;
+                queue_cond.notify_one();
+            }
+            if (writer.joinable())
+                writer.join();
+
+            {
+                std::lock_guard<std::mutex> guard(load_lock);
+                loaders_stopping = true;
+                load_cond.notify_all();
+            }
+            for (std::vector<std::thread>::iterator it = loaders.begin(); it != loaders.end(); ++it)
+                it->join();
+        }
     };
 }
 
@@ -128,6 +448,10 @@ StorageManager::~StorageManager()
 
 void StorageManager::unregister_backend(StorageManager::BackendId id)
 {
+    // A queued write or load may still refer to it.
+    _imp->flush();
+    _imp->wait_for_loads();
+
     BackendList::iterator it = _imp->find_by_id(id);
     if (it != _imp->backends.end())
         _imp->backends.erase(it);
@@ -157,11 +481,49 @@ void StorageManager::auto_save(const eir::Value * v, std::string dest)
 
 void StorageManager::Save(const eir::Value & v, std::string dest)
 {
-    _imp->do_save(v, dest);
+    bool failed = false;
+    std::string error;
+
+    _imp->queue_save(v, dest, [&failed, &error] (const Implementation<StorageManager>::WriteJob & job) {
+        failed = job.failed;
+        error = job.error;
+    });
+    _imp->flush();
+
+    if (failed)
+        throw IOError("Couldn't save " + dest + ": " + error);
+}
+
+void StorageManager::flush()
+{
+    _imp->flush();
+}
+
+void StorageManager::LoadAsync(std::string src, LoadCallback loaded, LoadErrorCallback failed)
+{
+    _imp->flush();
+
+    try
+    {
+        _imp->queue_load(src, loaded, failed);
+    }
+    catch (StorageError & e)
+    {
+        if (failed)
+            failed(e.message());
+    }
+}
+
+void StorageManager::finish_loads()
+{
+    _imp->finish_loads();
 }
 
 eir::Value StorageManager::Load(std::string src)
 {
+    // Make sure we don't read back something older than what was last saved.
+    _imp->flush();
+
     std::string type, source;
     _imp->split_storage_dest(src, type, source);
 
@@ -173,6 +535,158 @@ eir::Value StorageManager::Load(std::string src)
     return it->be->Load(source);
 }
 
+AtomicFileWriter::AtomicFileWriter(const std::string & filename)
+    : _filename(filename), _tmpname(filename + ".tmp"), _used(0)
+{
+    _fd = open(_tmpname.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (_fd < 0)
+        throw IOError("Couldn't open " + _tmpname + ": " + strerror(errno));
+}
+
+AtomicFileWriter::~AtomicFileWriter()
+{
+    // Not committed, so whatever was written is thrown away.
+    if (_fd >= 0)
+    {
+        close(_fd);
+        unlink(_tmpname.c_str());
+    }
+}
+
+void AtomicFileWriter::write(const char *data, std::size_t len)
+{
+    if (_used + len > sizeof _buffer)
+        flush();
+
+    if (len >= sizeof _buffer)
+        write_out(data, len);
+    else
+    {
+        memcpy(_buffer + _used, data, len);
+        _used += len;
+    }
+}
+
+void AtomicFileWriter::flush()
+{
+    write_out(_buffer, _used);
+    _used = 0;
+}
+
+void AtomicFileWriter::write_out(const char *p, std::size_t left)
+{
+    while (left > 0)
+    {
+        ssize_t n = ::write(_fd, p, left);
+        if (n < 0 && errno != EINTR)
+            throw IOError("Error writing " + _tmpname + ": " + strerror(errno));
+        else if (n > 0)
+        {
+            p += n;
+            left -= n;
+        }
+    }
+}
+
+void AtomicFileWriter::commit()
+{
+    flush();
+
+    int err = 0;
+    if (fsync(_fd) < 0)
+        err = errno;
+    if (close(_fd) < 0 && !err)
+        err = errno;
+    _fd = -1;
+
+    if (err)
+    {
+        unlink(_tmpname.c_str());
+        throw IOError("Error writing " + _tmpname + ": " + strerror(err));
+    }
+
+    if (rename(_tmpname.c_str(), _filename.c_str()) < 0)
+    {
+        err = errno;
+        unlink(_tmpname.c_str());
+        throw IOError("Couldn't rename " + _tmpname + " to " + _filename + ": " + strerror(err));
+    }
+
+    // The rename itself isn't durable until the directory is synced too.
+    std::string::size_type slash = _filename.rfind('/');
+    std::string dirname = slash == std::string::npos ? "." : slash == 0 ? "/" : _filename.substr(0, slash);
+    int dirfd = open(dirname.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirfd >= 0)
+    {
+        fsync(dirfd);
+        close(dirfd);
+    }
+}
+
+void eir::write_file_atomically(const std::string & filename, const std::string & data)
+{
+    AtomicFileWriter file(filename);
+    file.write(data);
+    file.commit();
+}
+
+std::string eir::read_whole_file(const std::string & filename)
+{
+    int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw IOError("Couldn't open " + filename + ": " + strerror(errno));
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || S_ISDIR(st.st_mode))
+    {
+        close(fd);
+        throw IOError("Error reading from " + filename + ": not a file");
+    }
+
+    // Regular files are read in one go, with room left over for the read that
+    // finds the end; anything else grows as it's read.
+    std::string data;
+    std::size_t used = 0;
+    int err = 0;
+
+    try
+    {
+        data.resize(S_ISREG(st.st_mode) ? st.st_size + 1 : 64 * 1024);
+
+        while (true)
+        {
+            if (used == data.size())
+                data.resize(data.size() * 2);
+
+            ssize_t n = read(fd, &data[used], data.size() - used);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
+                err = errno;
+            if (n <= 0)
+                break;
+            used += n;
+        }
+    }
+    catch (std::length_error &)
+    {
+        close(fd);
+        throw IOError("Error reading from " + filename + ": bad size");
+    }
+    catch (std::bad_alloc &)
+    {
+        close(fd);
+        throw IOError("Error reading from " + filename + ": bad size");
+    }
+
+    close(fd);
+    if (err)
+        throw IOError("Error reading from " + filename + ": " + strerror(err));
+
+    data.resize(used);
+    return data;
+}
+
 std::string StorageManager::default_backend()
 {
     return _imp->default_backend->type;
@@ -3,8 +3,17 @@
 
 #include "value.h"
 
+#include <functional>
+
 namespace eir
 {
+    /*
+     * Save is called on the storage writer thread, with a private snapshot of
+     * the value. Load is called on the main thread, or on a loader thread for
+     * LoadAsync, possibly while other targets are being loaded or saved.
+     * Neither should use the Logger directly; post anything to be logged to the
+     * main loop.
+     */
     class StorageBackend
     {
         public:
@@ -18,10 +27,28 @@ namespace eir
                            public paludis::InstantiationPolicy<StorageManager, paludis::instantiation_method::SingletonTag>
     {
         public:
+            // Values are written out by a background thread. Save still waits for
+            // its own write to finish, and throws if it failed; auto-saves don't.
             void Save(const eir::Value &, std::string);
             eir::Value Load(std::string);
             void auto_save(const eir::Value *, std::string);
 
+            // Waits until everything queued so far has been written.
+            void flush();
+
+            /*
+             * Loads on a background thread, alongside any other loads, then calls
+             * back from the main loop with the value or with why it couldn't be
+             * loaded. Until then, auto-saves to the same name are held back, so
+             * that a placeholder can't overwrite what's stored.
+             */
+            typedef std::function<void (const eir::Value &)> LoadCallback;
+            typedef std::function<void (const std::string &)> LoadErrorCallback;
+            void LoadAsync(std::string, LoadCallback, LoadErrorCallback);
+
+            // Waits for every outstanding LoadAsync and runs its callback.
+            void finish_loads();
+
             typedef unsigned int BackendId;
             BackendId register_backend(std::string, StorageBackend *);
             void unregister_backend(BackendId);
@@ -32,6 +59,51 @@ namespace eir
             StorageManager();
             ~StorageManager();
     };
+
+    /*
+     * Writes to a temporary file next to the target, fsyncs it, and renames it
+     * into place, so that a crash leaves either the old contents or the new.
+     * Throws IOError.
+     */
+    void write_file_atomically(const std::string & filename, const std::string & data);
+
+    /*
+     * Reads a whole file into memory. Throws IOError if it can't be opened or
+     * read, including when it's a directory or too big to hold.
+     */
+    std::string read_whole_file(const std::string & filename);
+
+    /*
+     * The same, for output written a piece at a time through a fixed-size
+     * buffer rather than built up in memory first. Nothing replaces the target
+     * until commit(); a writer destroyed before then removes its temporary file.
+     */
+    class AtomicFileWriter : public paludis::InstantiationPolicy<AtomicFileWriter, paludis::instantiation_method::NonCopyableTag>
+    {
+        public:
+            AtomicFileWriter(const std::string & filename);
+            ~AtomicFileWriter();
+
+            void write(const char *, std::size_t);
+            void write(const std::string & s) { write(s.data(), s.size()); }
+            void put(char c)
+            {
+                if (_used == sizeof _buffer)
+                    flush();
+                _buffer[_used++] = c;
+            }
+
+            void commit();
+
+        private:
+            void flush();
+            void write_out(const char *, std::size_t);
+
+            std::string _filename, _tmpname;
+            int _fd;
+            std::size_t _used;
+            char _buffer[64 * 1024];
+    };
 }
 
 #endif
@@ -1,5 +1,9 @@
 #include "string_util.h"
 
+#include <random>
+#include <ctime>
+#include <unistd.h>
+
 namespace eir
 {
     namespace cistring
@@ -39,6 +43,74 @@ namespace eir
                 0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9,
                 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff
         };
+
+        namespace
+        {
+            struct casemap_tables
+            {
+                unsigned char strict[256];
+                unsigned char ascii[256];
+
+                casemap_tables()
+                {
+                    for (int i = 0; i < 256; ++i)
+                    {
+                        ascii[i] = (i >= 'A' && i <= 'Z') ? i + ('a' - 'A') : i;
+                        strict[i] = tolowertab[i];
+                    }
+                    // strict-rfc1459 doesn't treat ^ and ~ as equivalent.
+                    strict[(unsigned char)'^'] = '^';
+                }
+            };
+
+            const casemap_tables &tables()
+            {
+                static casemap_tables t;
+                return t;
+            }
+
+            uint64_t make_seed()
+            {
+                uint64_t seed = uint64_t(time(NULL)) << 32 ^ uint64_t(getpid());
+                try
+                {
+                    std::random_device rd;
+                    seed ^= uint64_t(rd()) << 32 | rd();
+                }
+                catch (std::exception &)
+                {
+                }
+                return seed;
+            }
+        }
+
+        const uint64_t hash_seed = make_seed();
+
+        const unsigned char *table_for(casemapping m)
+        {
+            switch (m)
+            {
+                case strict_rfc1459:
+                    return tables().strict;
+                case ascii:
+                    return tables().ascii;
+                case rfc1459:
+                    break;
+            }
+            return tolowertab;
+        }
+
+        bool parse_casemapping(const std::string &name, casemapping &m)
+        {
+            if (name == "rfc1459")
+                m = rfc1459;
+            else if (name == "strict-rfc1459")
+                m = strict_rfc1459;
+            else if (name == "ascii")
+                m = ascii;
+            else
+                return false;
+            return true;
+        }
     }
 }
-
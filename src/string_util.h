@@ -5,6 +5,7 @@
 #include <algorithm>
 #include <iterator>
 #include <cctype>
+#include <cstdint>
 
 namespace eir
 {
@@ -18,50 +19,98 @@ namespace eir
 
     namespace cistring
     {
+        // The rfc1459 table, used when no other casemapping is given.
         extern unsigned char tolowertab[256];
 
-        inline bool equal(std::string lhs, std::string rhs)
+        enum casemapping {
+            rfc1459,
+            strict_rfc1459,
+            ascii
+        };
+
+        const unsigned char *table_for(casemapping);
+        bool parse_casemapping(const std::string &, casemapping &);
+
+        inline bool equal(const std::string &lhs, const std::string &rhs, const unsigned char *tab = tolowertab)
         {
             if (lhs.size() != rhs.size()) return false;
 
             for (std::string::size_type i=0; i < lhs.size(); i++)
             {
-                if (tolowertab[(unsigned char)lhs[i]] != tolowertab[(unsigned char)rhs[i]]) return false;
+                if (tab[(unsigned char)lhs[i]] != tab[(unsigned char)rhs[i]]) return false;
             }
             return true;
         }
 
-        inline bool less(std::string lhs, std::string rhs)
+        inline bool less(const std::string &lhs, const std::string &rhs, const unsigned char *tab = tolowertab)
         {
             for (std::string::size_type i=0; ; i++)
             {
-                if (i == lhs.size()) return true;
                 if (i == rhs.size()) return false;
-                if (tolowertab[(unsigned char)lhs[i]] < tolowertab[(unsigned char)rhs[i]]) return true;
-                if (tolowertab[(unsigned char)lhs[i]] > tolowertab[(unsigned char)rhs[i]]) return false;
+                if (i == lhs.size()) return true;
+                if (tab[(unsigned char)lhs[i]] < tab[(unsigned char)rhs[i]]) return true;
+                if (tab[(unsigned char)lhs[i]] > tab[(unsigned char)rhs[i]]) return false;
             }
             return false;
         }
 
-        inline unsigned long hash(std::string arg)
+        // Randomised at startup, so that nick choices can't be used to force collisions.
+        extern const uint64_t hash_seed;
+
+        namespace detail
+        {
+            inline uint64_t mix(uint64_t h, uint64_t w)
+            {
+                h ^= w;
+                h *= 0x9e3779b97f4a7c15ULL;
+                return h ^ (h >> 29);
+            }
+        }
+
+        // 64-bit hash of the case-folded string, eight folded bytes at a time.
+        inline uint64_t hash(const std::string &arg, const unsigned char *tab = tolowertab)
         {
-            unsigned long ret = 5381;
-            for (std::string::size_type i=0; i < arg.size(); ++i)
-                ret = ret * 33 ^ tolowertab[(unsigned char)arg[i]];
-            return ret;
+            const unsigned char *p = reinterpret_cast<const unsigned char *>(arg.data());
+            std::string::size_type n = arg.size(), i = 0;
+            uint64_t h = hash_seed ^ (n * 0xff51afd7ed558ccdULL);
+
+            for ( ; i + 8 <= n; i += 8)
+            {
+                uint64_t w = uint64_t(tab[p[i]])           | uint64_t(tab[p[i+1]]) << 8  |
+                             uint64_t(tab[p[i+2]]) << 16   | uint64_t(tab[p[i+3]]) << 24 |
+                             uint64_t(tab[p[i+4]]) << 32   | uint64_t(tab[p[i+5]]) << 40 |
+                             uint64_t(tab[p[i+6]]) << 48   | uint64_t(tab[p[i+7]]) << 56;
+                h = detail::mix(h, w);
+            }
+
+            uint64_t w = 0;
+            for (unsigned int shift = 0; i < n; ++i, shift += 8)
+                w |= uint64_t(tab[p[i]]) << shift;
+            h = detail::mix(h, w);
+
+            h ^= h >> 33;
+            h *= 0xc4ceb9fe1a85ec53ULL;
+            h ^= h >> 33;
+            return h;
         }
 
         struct is_equal
         {
-            bool operator() (std::string l, std::string r) const { return equal(l, r); }
+            const unsigned char *tab;
+            is_equal(const unsigned char *t = tolowertab) : tab(t) { }
+            bool operator() (const std::string &l, const std::string &r) const { return equal(l, r, tab); }
         };
         struct is_less
         {
-            bool operator() (std::string l, std::string r) const { return less(l, r); }
+            const unsigned char *tab;
+            is_less(const unsigned char *t = tolowertab) : tab(t) { }
+            bool operator() (const std::string &l, const std::string &r) const { return less(l, r, tab); }
         };
         struct hasher
         {
-            bool operator() (std::string s) const { return hash(s); }
+            const unsigned char *tab;
+            hasher(const unsigned char *t = tolowertab) : tab(t) { }
+            std::size_t operator() (const std::string &s) const { return hash(s, tab); }
         };
     }
 }
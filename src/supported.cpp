@@ -26,6 +26,8 @@ namespace paludis
 
         std::string _chantypes;
 
+        cistring::casemapping _casemapping;
+
         void _populate(const Message *m);
         void _populate_prefix_modes(std::string);
         void _populate_chanmodes(std::string);
@@ -33,6 +35,7 @@ namespace paludis
         CommandHolder _handler_id;
 
         Implementation(Bot *b)
+            : _max_modes(0), _casemapping(cistring::rfc1459)
         {
             _handler_id = add_handler(filter_command("005").from_bot(b), &Implementation<ISupport>::_populate);
         }
@@ -107,6 +110,8 @@ void Implementation<ISupport>::_populate(const eir::Message *m)
                 _populate_prefix_modes(value);
             else if (name == "MODES")
                 _max_modes = atoi(value.c_str());
+            else if (name == "CASEMAPPING" && ! cistring::parse_casemapping(value, _casemapping))
+                _casemapping = cistring::rfc1459;
 
             kv_tokens[name] = value;
 
@@ -216,6 +221,8 @@ std::string ISupport::prefix_modes() const { return _imp->_prefix_modes; }
 
 int ISupport::max_modes() const { return _imp->_max_modes; }
 
+cistring::casemapping ISupport::casemapping() const { return _imp->_casemapping; }
+
 ISupport::ISupport(Bot *b)
     : PrivateImplementationPattern<ISupport>(new Implementation<ISupport>(b))
 {
@@ -3,6 +3,7 @@
 
 #include <paludis/util/instantiation_policy.hh>
 #include <paludis/util/private_implementation_pattern.hh>
+#include "string_util.h"
 #include <string>
 #include <set>
 #include <map>
@@ -58,6 +59,8 @@ namespace eir
 
             bool is_channel_name(std::string) const;
 
+            cistring::casemapping casemapping() const;
+
             ISupport(Bot*);
             ~ISupport();
     };
@@ -1,8 +1,12 @@
 #include "value.h"
+#include "memory.h"
 
 #include <vector>
-#include <unordered_map>
+#include <map>
 #include <memory>
+#include <new>
+#include <atomic>
+#include <mutex>
 
 #include <paludis/util/private_implementation_pattern-impl.hh>
 #include <paludis/util/wrapped_forward_iterator-impl.hh>
@@ -12,209 +16,603 @@
 using namespace eir;
 using namespace paludis;
 
-template class paludis::WrappedForwardIterator<KeyValueArray::KeyValueArrayIteratorTag, std::pair<const std::string, Value> >;
-template class paludis::WrappedForwardIterator<KeyValueArray::KeyValueArrayIteratorTag, const std::pair<const std::string, Value> >;
+template class paludis::WrappedForwardIterator<KeyValueArray::KeyValueArrayIteratorTag, KeyValueArray::value_type>;
+template class paludis::WrappedForwardIterator<KeyValueArray::KeyValueArrayIteratorTag, const KeyValueArray::value_type>;
 template class paludis::WrappedForwardIterator<ValueArray::ValueArrayIteratorTag, Value>;
 template class paludis::WrappedForwardIterator<ValueArray::ValueArrayIteratorTag, const Value>;
 
-namespace paludis
+namespace
 {
-    template <>
-    struct Implementation<Value>
+    std::atomic<unsigned long> last_generation(0);
+
+    unsigned long next_generation()
     {
-        // This shouldn't really be mutable, but it lets us initialise an empty type
-        // to a meaningful one in what are still semantically const operations.
-        mutable Value::ValueType _type;
-        int _intval;
-        std::string _stringval;
-        std::shared_ptr<ValueArray> _array;
-        std::shared_ptr<KeyValueArray> _kv_array;
+        return last_generation.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
 
-        Implementation(Value::ValueType t)
-            : _type(t)
-        {  }
+    typedef KeyValueArray::value_type KVEntry;
 
-        void clear()
+    struct KVNode
+    {
+        std::string key;
+        KVEntry entry;
+        std::size_t hash;
+        KVNode *bucket_next, *prev, *next;
+
+        KVNode(std::string k, Value v, std::size_t h)
+            : key(std::move(k)), entry(key, std::move(v)), hash(h), bucket_next(0), prev(0), next(0)
+        { }
+    };
+
+    // Visits the present schema slots in order, then the other entries in the
+    // order they were added.
+    template <typename Entry_>
+    struct KVIteratorImpl
+    {
+        KVEntry *slot, *slots_end;
+        KVNode *node;
+
+        KVIteratorImpl(KVEntry *s, KVEntry *se, KVNode *n)
+            : slot(s), slots_end(se), node(n)
         {
-            _intval = 0;
-            _stringval = "";
-            _array.reset();
-            _kv_array.reset();
+            skip_absent();
         }
 
-        void NeedType(Value::ValueType t) const
+        void skip_absent()
         {
-            if (_type == Value::empty)
-            {
-                switch (t)
-                {
-                    case Value::empty:
-                    case Value::integer:
-                    case Value::string:
-                        // These three we can switch to without needing to initialise.
-                        _type = t;
-                        return;
-                    case Value::array:
-                    case Value::kvarray:
-                        // These two we can't.
-                        throw TypeMismatchException(t, _type);
-                }
-            }
-            else if (_type != t)
-            {
-                throw TypeMismatchException(t, _type);
-            }
+            while (slot && slot != slots_end && slot->second.Type() == Value::empty)
+                ++slot;
+            if (slot == slots_end)
+                slot = 0;
         }
 
-        void NeedType(Value::ValueType t)
+        KVIteratorImpl & operator++ ()
         {
-            if (_type == Value::empty)
-            {
-                _type = t;
-            }
-            else if (_type != t)
-            {
-                throw TypeMismatchException(t, _type);
-            }
-            switch (t)
+            if (slot)
             {
-                case Value::empty:
-                case Value::integer:
-                case Value::string:
-                    return;
-                case Value::array:
-                    if (!_array) _array.reset(new ValueArray);
-                    return;
-                case Value::kvarray:
-                    if (!_kv_array) _kv_array.reset(new KeyValueArray);
-                    return;
+                ++slot;
+                skip_absent();
             }
+            else
+                node = node->next;
+            return *this;
         }
+
+        Entry_ & operator* () const { return slot ? *slot : node->entry; }
+        Entry_ * operator-> () const { return slot ? slot : &node->entry; }
+        bool operator== (const KVIteratorImpl &other) const { return slot == other.slot && node == other.node; }
     };
 
+    typedef KVIteratorImpl<KVEntry> KVIterator;
+    typedef KVIteratorImpl<const KVEntry> KVConstIterator;
+}
+
+namespace paludis
+{
     template <>
     struct Implementation<ValueArray>
     {
         std::vector<Value> _array;
+        unsigned long generation;
+
+        Implementation()
+            : generation(next_generation())
+        { }
+
+        Implementation(const Implementation &other)
+            : _array(other._array), generation(next_generation())
+        { }
     };
 
     template <>
     struct Implementation<KeyValueArray>
     {
-        std::unordered_map<std::string, Value> _map;
-    };
-}
+        // Fields in the schema, if there is one, live in slots. Everything else is
+        // chained into its hash bucket, and also onto a list in insertion order
+        // which is what iteration follows.
+        RecordSchema::ptr schema;
+        std::vector<KVEntry> slots;
 
-Value::Value()
-    : PrivateImplementationPattern<Value>(new Implementation<Value>(empty))
-{
-}
+        std::vector<KVNode *> buckets;
+        KVNode *first, *last;
+        std::size_t count;
 
-Value::Value(Value::ValueType t)
-    : PrivateImplementationPattern<Value>(new Implementation<Value>(t))
-{
-    if (t == array)
-        _imp->_array.reset(new ValueArray);
-    if (t == kvarray)
-        _imp->_kv_array.reset(new KeyValueArray);
-}
+        unsigned long generation;
 
-Value::Value(int i)
-    : PrivateImplementationPattern<Value>(new Implementation<Value>(integer))
-{
-    _imp->_intval = i;
+        Implementation()
+            : first(0), last(0), count(0), generation(next_generation())
+        { }
+
+        Implementation(RecordSchema::ptr s)
+            : schema(s), first(0), last(0), count(0), generation(next_generation())
+        {
+            slots.reserve(schema->size());
+            for (std::size_t i = 0; i < schema->size(); ++i)
+                slots.push_back(KVEntry(schema->field(i), Value()));
+        }
+
+        Implementation(const Implementation &other)
+            : schema(other.schema), slots(other.slots), first(0), last(0), count(0),
+              generation(next_generation())
+        {
+            for (KVNode *n = other.first; n; n = n->next)
+                append(new KVNode(n->key, n->entry.second, n->hash));
+        }
+
+        ~Implementation()
+        {
+            clear();
+        }
+
+        KVEntry *find_slot(const char *key, std::size_t len, std::size_t hash) const
+        {
+            if (!schema)
+                return 0;
+            int i = schema->slot(key, len, hash);
+            return i < 0 ? 0 : const_cast<KVEntry *>(&slots[i]);
+        }
+
+        KVNode *find_node(const char *key, std::size_t len, std::size_t hash) const
+        {
+            if (buckets.empty())
+                return 0;
+
+            for (KVNode *n = buckets[hash & (buckets.size() - 1)]; n; n = n->bucket_next)
+                if (n->hash == hash && n->key.size() == len &&
+                        std::char_traits<char>::compare(n->key.data(), key, len) == 0)
+                    return n;
+            return 0;
+        }
+
+        template <typename Iter_>
+        Iter_ begin_at(KVEntry *slot, KVNode *node) const
+        {
+            KVEntry *slots_begin = const_cast<KVEntry *>(slots.data());
+            return Iter_(slot, slots_begin + slots.size(), node);
+        }
+
+        template <typename Iter_>
+        Iter_ begin() const
+        {
+            return slots.empty() ? Iter_(0, 0, first) : begin_at<Iter_>(const_cast<KVEntry *>(slots.data()), first);
+        }
+
+        template <typename Iter_>
+        Iter_ find(const char *key, std::size_t len, std::size_t hash) const
+        {
+            if (KVEntry *slot = find_slot(key, len, hash))
+                if (slot->second.Type() != Value::empty)
+                    return begin_at<Iter_>(slot, first);
+
+            return Iter_(0, 0, find_node(key, len, hash));
+        }
+
+        // Like find, but without building an iterator. An absent field's slot is
+        // returned as it is, since it holds an empty Value anyway.
+        const Value *lookup(const char *key, std::size_t len, std::size_t hash) const
+        {
+            if (KVEntry *slot = find_slot(key, len, hash))
+                return &slot->second;
+
+            KVNode *n = find_node(key, len, hash);
+            return n ? &n->entry.second : 0;
+        }
+
+        Value &get(const char *key, std::size_t len, std::size_t hash)
+        {
+            if (KVEntry *slot = find_slot(key, len, hash))
+                return slot->second;
+
+            KVNode *n = find_node(key, len, hash);
+            if (!n)
+                n = append(new KVNode(std::string(key, len), Value(), hash));
+            return n->entry.second;
+        }
+
+        void rehash(std::size_t size)
+        {
+            buckets.assign(size, 0);
+            for (KVNode *n = first; n; n = n->next)
+            {
+                KVNode *&head = buckets[n->hash & (size - 1)];
+                n->bucket_next = head;
+                head = n;
+            }
+        }
+
+        KVNode *append(KVNode *n)
+        {
+            if (count >= buckets.size())
+                rehash(buckets.empty() ? 8 : buckets.size() * 2);
+
+            KVNode *&head = buckets[n->hash & (buckets.size() - 1)];
+            n->bucket_next = head;
+            head = n;
+
+            n->prev = last;
+            n->next = 0;
+            if (last)
+                last->next = n;
+            else
+                first = n;
+            last = n;
+
+            ++count;
+            return n;
+        }
+
+        void remove(KVNode *n)
+        {
+            KVNode **link = &buckets[n->hash & (buckets.size() - 1)];
+            while (*link != n)
+                link = &(*link)->bucket_next;
+            *link = n->bucket_next;
+
+            if (n->prev)
+                n->prev->next = n->next;
+            else
+                first = n->next;
+            if (n->next)
+                n->next->prev = n->prev;
+            else
+                last = n->prev;
+
+            --count;
+            delete n;
+        }
+
+        std::size_t size() const
+        {
+            std::size_t ret = count;
+            for (std::vector<KVEntry>::const_iterator it = slots.begin(); it != slots.end(); ++it)
+                if (it->second.Type() != Value::empty)
+                    ++ret;
+            return ret;
+        }
+
+        void clear()
+        {
+            for (std::vector<KVEntry>::iterator it = slots.begin(); it != slots.end(); ++it)
+                it->second = Value();
+
+            while (first)
+            {
+                KVNode *n = first;
+                first = n->next;
+                delete n;
+            }
+            last = 0;
+            count = 0;
+            buckets.clear();
+        }
+    };
 }
 
-Value::Value(const char *s)
-    : PrivateImplementationPattern<Value>(new Implementation<Value>(string))
+void Value::destroy() noexcept
 {
-    _imp->_stringval = s;
+    switch (_type)
+    {
+        case empty:
+        case integer:
+            break;
+        case string:
+            _stringval.~basic_string();
+            break;
+        case array:
+            _array.~shared_ptr();
+            break;
+        case kvarray:
+            _kv_array.~shared_ptr();
+            break;
+    }
+    _type = empty;
 }
 
-Value::Value(std::string s)
-    : PrivateImplementationPattern<Value>(new Implementation<Value>(string))
+void Value::construct_from(const Value& rhs)
 {
-    _imp->_stringval = s;
+    switch (rhs._type)
+    {
+        case empty:
+            break;
+        case integer:
+            _intval = rhs._intval;
+            break;
+        case string:
+            new (&_stringval) std::string(rhs._stringval);
+            break;
+        case array:
+            new (&_array) std::shared_ptr<ValueArray>(rhs._array);
+            break;
+        case kvarray:
+            new (&_kv_array) std::shared_ptr<KeyValueArray>(rhs._kv_array);
+            break;
+    }
+    _type = rhs._type;
 }
 
-Value::Value(const Value& rhs)
-    : PrivateImplementationPattern<Value>(new Implementation<Value>(rhs.Type()))
+void Value::construct_from(Value&& rhs) noexcept
 {
-    switch(Type())
+    switch (rhs._type)
     {
         case empty:
             break;
         case integer:
-            _imp->_intval = rhs.Int();
+            _intval = rhs._intval;
             break;
         case string:
-            _imp->_stringval = (std::string)rhs;
+            new (&_stringval) std::string(std::move(rhs._stringval));
             break;
         case array:
-            _imp->_array = rhs._imp->_array;
+            new (&_array) std::shared_ptr<ValueArray>(std::move(rhs._array));
             break;
         case kvarray:
-            _imp->_kv_array = rhs._imp->_kv_array;
+            new (&_kv_array) std::shared_ptr<KeyValueArray>(std::move(rhs._kv_array));
             break;
     }
+    _type = rhs._type;
+    // A moved-from array would hold a null pointer, so leave the source empty.
+    rhs.destroy();
 }
 
-const Value& Value::operator= (const Value& rhs)
+void Value::NeedType(Value::ValueType t) const
 {
-    if (Type() != rhs.Type())
+    if (_type == empty)
     {
-        _imp->clear();
-        _imp->_type = rhs.Type();
+        switch (t)
+        {
+            case empty:
+                return;
+            case integer:
+            case string:
+                // These two we can switch to without any outside effect.
+                const_cast<Value*>(this)->NeedType(t);
+                return;
+            case array:
+            case kvarray:
+                // These two we can't.
+                throw TypeMismatchException(t, _type);
+        }
     }
+    else if (_type != t)
+    {
+        throw TypeMismatchException(t, _type);
+    }
+}
 
-    switch(Type())
+void Value::NeedType(Value::ValueType t)
+{
+    if (_type == t)
+    {
+        // Anyone asking for non-const access to an array is about to modify it.
+        if (t == array)
+        {
+            if (_array.use_count() > 1)
+                _array.reset(new ValueArray(*_array));
+            _array->_imp->generation = next_generation();
+        }
+        else if (t == kvarray)
+        {
+            if (_kv_array.use_count() > 1)
+                _kv_array.reset(new KeyValueArray(*_kv_array));
+            _kv_array->_imp->generation = next_generation();
+        }
+        return;
+    }
+
+    if (_type != empty)
+        throw TypeMismatchException(t, _type);
+
+    switch (t)
     {
         case empty:
             break;
         case integer:
-            _imp->_intval = rhs.Int();
+            _intval = 0;
             break;
         case string:
-            _imp->_stringval = (std::string)rhs;
+            new (&_stringval) std::string;
             break;
         case array:
-            _imp->_array = rhs._imp->_array;
+            new (&_array) std::shared_ptr<ValueArray>(std::make_shared<ValueArray>());
             break;
         case kvarray:
-            _imp->_kv_array = rhs._imp->_kv_array;
+            new (&_kv_array) std::shared_ptr<KeyValueArray>(std::make_shared<KeyValueArray>());
             break;
     }
+    _type = t;
+}
+
+Value::Value(Value::ValueType t)
+    : _type(empty), _intval(0)
+{
+    NeedType(t);
+}
+
+Value::Value(const char *s)
+    : _type(string), _stringval(s)
+{
+}
+
+Value::Value(std::string s)
+    : _type(string), _stringval(std::move(s))
+{
+}
 
+Value::Value(const Value& rhs)
+    : _type(empty), _intval(0)
+{
+    construct_from(rhs);
+}
+
+Value::Value(Value&& rhs) noexcept
+    : _type(empty), _intval(0)
+{
+    construct_from(std::move(rhs));
+}
+
+const Value& Value::operator= (const Value& rhs)
+{
+    if (this != &rhs)
+    {
+        Value tmp(rhs);
+        swap(tmp);
+    }
     return *this;
 }
 
+const Value& Value::operator= (Value&& rhs) noexcept
+{
+    if (this != &rhs)
+    {
+        destroy();
+        construct_from(std::move(rhs));
+    }
+    return *this;
+}
 
-Value::~Value()
+void Value::swap(Value& other) noexcept
 {
+    if (this == &other)
+        return;
+
+    Value tmp(std::move(other));
+    other.construct_from(std::move(*this));
+    construct_from(std::move(tmp));
 }
 
-Value::ValueType Value::Type() const
+Value Value::clone() const
 {
-    return _imp->_type;
+    switch (_type)
+    {
+        case array:
+            {
+                Value ret(array);
+                std::vector<Value> &dest = ret._array->_imp->_array;
+                dest.reserve(_array->size());
+                for (ValueArray::const_iterator it = _array->begin(); it != _array->end(); ++it)
+                    dest.push_back(it->clone());
+                return ret;
+            }
+        case kvarray:
+            {
+                // Copy the table first so that a record keeps its schema.
+                Value ret;
+                new (&ret._kv_array) std::shared_ptr<KeyValueArray>(new KeyValueArray(*_kv_array));
+                ret._type = kvarray;
+                for (KeyValueArray::iterator it = ret._kv_array->begin(); it != ret._kv_array->end(); ++it)
+                    it->second = it->second.clone();
+                return ret;
+            }
+        default:
+            return *this;
+    }
+}
+
+unsigned long Value::generation() const
+{
+    switch (_type)
+    {
+        case array:
+            return _array->_imp->generation;
+        case kvarray:
+            return _kv_array->_imp->generation;
+        default:
+            return 0;
+    }
+}
+
+bool Value::shares_contents(const Value& other) const
+{
+    if (_type != other._type)
+        return false;
+
+    switch (_type)
+    {
+        case array:
+            return _array == other._array;
+        case kvarray:
+            return _kv_array == other._kv_array;
+        default:
+            return false;
+    }
+}
+
+bool Value::equals(const Value& other) const
+{
+    if (shares_contents(other))
+        return true;
+    if (_type != other._type)
+        return false;
+
+    switch (_type)
+    {
+        case empty:
+            return true;
+        case integer:
+            return _intval == other._intval;
+        case string:
+            return _stringval == other._stringval;
+        case array:
+            {
+                const ValueArray &lhs = *_array, &rhs = *other._array;
+                if (lhs.size() != rhs.size())
+                    return false;
+                for (size_t i = 0; i < lhs.size(); ++i)
+                    if (!lhs[i].equals(rhs[i]))
+                        return false;
+                return true;
+            }
+        case kvarray:
+            {
+                const KeyValueArray &lhs = *_kv_array, &rhs = *other._kv_array;
+                if (lhs.size() != rhs.size())
+                    return false;
+                for (KeyValueArray::const_iterator it = lhs.begin(); it != lhs.end(); ++it)
+                {
+                    KeyValueArray::const_iterator found = rhs.find(it->first);
+                    if (found == rhs.end() || !it->second.equals(found->second))
+                        return false;
+                }
+                return true;
+            }
+    }
+    return false;
+}
+
+bool Value::unique() const
+{
+    switch (_type)
+    {
+        case array:
+            return _array.use_count() == 1;
+        case kvarray:
+            return _kv_array.use_count() == 1;
+        default:
+            return true;
+    }
 }
 
 const Value& Value::operator=(int i)
 {
-    if (_imp->_type != integer)
-        _imp->clear();
+    if (_type != integer)
+        destroy();
 
-    _imp->_type = integer;
-    _imp->_intval = i;
+    _intval = i;
+    _type = integer;
     return *this;
 }
 
 const Value& Value::operator=(const std::string& s)
 {
-    if (_imp->_type != string)
-        _imp->clear();
+    if (_type == string)
+    {
+        _stringval = s;
+        return *this;
+    }
 
-    _imp->_type = string;
-    _imp->_stringval = s;
+    destroy();
+    new (&_stringval) std::string(s);
+    _type = string;
     return *this;
 }
 
@@ -223,7 +621,7 @@ Value::operator int() const
 {
     if (_imp->_type != Int)
         throw TypeMismatchException(Int, _imp->_type);
-    return _imp->_intval;
+    return _intval;
 }
 */
 
@@ -239,13 +637,13 @@ Value::operator bool() const
         case empty:
             return false;
         case integer:
-            return _imp->_intval != 0;
+            return _intval != 0;
         case string:
-            return !_imp->_stringval.empty();
+            return !_stringval.empty();
         case array:
-            return !_imp->_array->empty();
+            return !_array->empty();
         case kvarray:
-            return !_imp->_kv_array->empty();
+            return !_kv_array->empty();
     }
     throw InternalError("Don't know what type of value I am.");
 }
@@ -255,11 +653,11 @@ int Value::Int() const
     switch(Type())
     {
         case integer:
-            return _imp->_intval;
+            return _intval;
         case string:
             try
             {
-                return paludis::destringify<int>(_imp->_stringval);
+                return paludis::destringify<int>(_stringval);
             }
             catch (paludis::DestringifyError)
             {
@@ -277,9 +675,9 @@ std::string Value::String() const
         case Value::empty:
             return "<null>";
         case Value::integer:
-            return stringify(_imp->_intval);
+            return stringify(_intval);
         case Value::string:
-            return _imp->_stringval;
+            return _stringval;
         case Value::array:
             return "<Array>";
         case Value::kvarray:
@@ -290,30 +688,30 @@ std::string Value::String() const
 
 ValueArray& Value::Array()
 {
-    _imp->NeedType(array);
+    NeedType(array);
 
-    return *_imp->_array;
+    return *_array;
 }
 
 const ValueArray& Value::Array() const
 {
-    _imp->NeedType(array);
+    NeedType(array);
 
-    return *_imp->_array;
+    return *_array;
 }
 
 KeyValueArray& Value::KV()
 {
-    _imp->NeedType(kvarray);
+    NeedType(kvarray);
 
-    return *_imp->_kv_array;
+    return *_kv_array;
 }
 
 const KeyValueArray& Value::KV() const
 {
-    _imp->NeedType(kvarray);
+    NeedType(kvarray);
 
-    return *_imp->_kv_array;
+    return *_kv_array;
 }
 
 Value& Value::operator[](int i)
@@ -331,37 +729,89 @@ Value& Value::operator[](int i)
 Value& Value::operator[](const std::string& s)
 {
     if (Type() == empty)
-        _imp->NeedType(kvarray);
+        NeedType(kvarray);
 
     if (Type() == kvarray)
         return KV()[s];
 
     throw TypeMismatchException(array, Type());
 }
+Value& Value::operator[](const ValueKey& k)
+{
+    if (Type() == empty)
+        NeedType(kvarray);
+
+    if (Type() == kvarray)
+        return KV()[k];
+
+    throw TypeMismatchException(array, Type());
+}
+
+namespace
+{
+    const Value no_value;
+}
+
+const Value& Value::operator[](const std::string& s) const
+{
+    return (*this)[ValueKey(s.data(), s.length())];
+}
+
+const Value& Value::operator[](const ValueKey& k) const
+{
+    if (Type() == empty)
+        return no_value;
+
+    if (Type() == kvarray)
+    {
+        const Value *v = _kv_array->_imp->lookup(k.data(), k.length(), k.hash());
+        return v ? *v : no_value;
+    }
+
+    throw TypeMismatchException(kvarray, Type());
+}
+
+const Value& Value::operator[](int i) const
+{
+    if (Type() == kvarray)
+        return (*this)[std::string(Value(i))];
+
+    if (Type() == array)
+        return Array()[i];
+
+    throw TypeMismatchException(array, Type());
+}
 
 void Value::push_back(Value v)
 {
-    _imp->NeedType(array);
+    NeedType(array);
 
-    _imp->_array->push_back(v);
+    _array->push_back(std::move(v));
 }
 
 ValueArray::iterator Value::erase(ValueArray::iterator it)
 {
-    _imp->NeedType(array);
+    NeedType(array);
 
-    return _imp->_array->erase(it);
+    return _array->erase(it);
 }
 
 void Value::clear()
 {
+    // No point copying shared contents only to throw them away.
     switch (Type())
     {
         case array:
-            _imp->_array->clear();
+            if (_array.use_count() > 1)
+                _array = std::make_shared<ValueArray>();
+            else
+                Array().clear();
             break;
         case kvarray:
-            _imp->_kv_array->clear();
+            if (_kv_array.use_count() > 1)
+                _kv_array = std::make_shared<KeyValueArray>();
+            else
+                KV().clear();
             break;
         default:
             break;
@@ -370,18 +820,28 @@ void Value::clear()
 
 ValueArray::iterator Value::begin()
 {
-    _imp->NeedType(array);
+    NeedType(array);
 
     return Array().begin();
 }
 
 ValueArray::iterator Value::end()
 {
-    _imp->NeedType(array);
+    NeedType(array);
 
     return Array().end();
 }
 
+ValueArray::const_iterator Value::begin() const
+{
+    return Array().begin();
+}
+
+ValueArray::const_iterator Value::end() const
+{
+    return Array().end();
+}
+
 
 ///////////////////////////////////////////////////////////////////////
 // ValueArray stuff
@@ -419,7 +879,7 @@ void ValueArray::resize(size_t newsize)
 
 void ValueArray::push_back(Value v)
 {
-    _imp->_array.push_back(v);
+    _imp->_array.push_back(std::move(v));
 }
 
 void ValueArray::pop_back()
@@ -486,6 +946,11 @@ ValueArray::~ValueArray()
 {
 }
 
+ValueArray::ValueArray(const ValueArray& other)
+    : PrivateImplementationPattern<ValueArray>(new Implementation<ValueArray>(*other._imp.get()))
+{
+}
+
 // KeyValueArray stuff
 
 KeyValueArray::KeyValueArray()
@@ -497,69 +962,205 @@ KeyValueArray::~KeyValueArray()
 {
 }
 
+KeyValueArray::KeyValueArray(const KeyValueArray& other)
+    : PrivateImplementationPattern<KeyValueArray>(new Implementation<KeyValueArray>(*other._imp.get()))
+{
+}
+
+KeyValueArray::KeyValueArray(RecordSchema::ptr schema)
+    : PrivateImplementationPattern<KeyValueArray>(new Implementation<KeyValueArray>(schema))
+{
+}
+
 KeyValueArray::iterator KeyValueArray::begin()
 {
-    return _imp->_map.begin();
+    return _imp->begin<KVIterator>();
 }
 
 KeyValueArray::const_iterator KeyValueArray::begin() const
 {
-    return _imp->_map.begin();
+    return _imp->begin<KVConstIterator>();
 }
 
 KeyValueArray::iterator KeyValueArray::end()
 {
-    return _imp->_map.end();
+    return KVIterator(0, 0, 0);
 }
 
 KeyValueArray::const_iterator KeyValueArray::end() const
 {
-    return _imp->_map.end();
+    return KVConstIterator(0, 0, 0);
+}
+
+KeyValueArray::iterator KeyValueArray::find(const std::string& s)
+{
+    return _imp->find<KVIterator>(s.data(), s.size(), ValueKey::hash(s.data(), s.size()));
 }
 
-KeyValueArray::iterator KeyValueArray::find(std::string s)
+KeyValueArray::const_iterator KeyValueArray::find(const std::string& s) const
 {
-    return _imp->_map.find(s);
+    return _imp->find<KVConstIterator>(s.data(), s.size(), ValueKey::hash(s.data(), s.size()));
 }
 
-KeyValueArray::const_iterator KeyValueArray::find(std::string s) const
+KeyValueArray::iterator KeyValueArray::find(const ValueKey& k)
 {
-    return _imp->_map.find(s);
+    return _imp->find<KVIterator>(k.data(), k.length(), k.hash());
+}
+
+KeyValueArray::const_iterator KeyValueArray::find(const ValueKey& k) const
+{
+    return _imp->find<KVConstIterator>(k.data(), k.length(), k.hash());
 }
 
 size_t KeyValueArray::size() const
 {
-    return _imp->_map.size();
+    return _imp->size();
 }
 
 bool KeyValueArray::insert(std::string s, Value v)
 {
-    return _imp->_map.insert(std::make_pair(s, v)).second;
+    std::size_t hash = ValueKey::hash(s.data(), s.size());
+
+    if (KVEntry *slot = _imp->find_slot(s.data(), s.size(), hash))
+    {
+        if (slot->second.Type() != Value::empty)
+            return false;
+        slot->second = std::move(v);
+        return true;
+    }
+
+    if (_imp->find_node(s.data(), s.size(), hash))
+        return false;
+
+    _imp->append(new KVNode(std::move(s), std::move(v), hash));
+    return true;
 }
 
-bool KeyValueArray::erase(std::string s)
+bool KeyValueArray::erase(const std::string& s)
 {
-    return _imp->_map.erase(s) > 0;
+    std::size_t hash = ValueKey::hash(s.data(), s.size());
+
+    if (KVEntry *slot = _imp->find_slot(s.data(), s.size(), hash))
+    {
+        bool present = slot->second.Type() != Value::empty;
+        slot->second = Value();
+        return present;
+    }
+
+    KVNode *n = _imp->find_node(s.data(), s.size(), hash);
+    if (!n)
+        return false;
+
+    _imp->remove(n);
+    return true;
 }
 
 KeyValueArray::iterator KeyValueArray::erase(KeyValueArray::iterator it)
 {
-    return _imp->_map.erase(it.underlying_iterator<std::unordered_map<std::string,Value>::iterator>());
+    KVIterator &i = it.underlying_iterator<KVIterator>();
+    if (i.slot)
+    {
+        i.slot->second = Value();
+        return ++i;
+    }
+
+    KVNode *next = i.node->next;
+    _imp->remove(i.node);
+    return KVIterator(0, 0, next);
 }
 
 void KeyValueArray::clear()
 {
-    _imp->_map.clear();
+    _imp->clear();
 }
 
 bool KeyValueArray::empty() const
 {
-    return _imp->_map.empty();
+    return _imp->size() == 0;
+}
+
+Value& KeyValueArray::operator[](const std::string& s)
+{
+    return _imp->get(s.data(), s.size(), ValueKey::hash(s.data(), s.size()));
+}
+
+Value& KeyValueArray::operator[](const ValueKey& k)
+{
+    return _imp->get(k.data(), k.length(), k.hash());
+}
+
+const RecordSchema *KeyValueArray::schema() const
+{
+    return _imp->schema.get();
 }
 
-Value& KeyValueArray::operator[](std::string s)
+std::size_t KeyValueArray::heap_bytes() const
 {
-    return _imp->_map[s];
+    std::size_t ret = sizeof(Implementation<KeyValueArray>) + _imp->slots.capacity() * sizeof(KVEntry) +
+                      _imp->buckets.capacity() * sizeof(KVNode *);
+    for (KVNode *n = _imp->first; n; n = n->next)
+        ret += sizeof(KVNode) + memory::string_heap_bytes(n->key);
+    return ret;
+}
+
+// RecordSchema stuff
+
+namespace
+{
+    std::map<std::vector<std::string>, RecordSchema::ptr> & schemas()
+    {
+        static std::map<std::vector<std::string>, RecordSchema::ptr> s;
+        return s;
+    }
+
+    // Schemas are looked up by storage loads on loader threads as well as on
+    // the main thread.
+    std::mutex & schemas_lock()
+    {
+        static std::mutex m;
+        return m;
+    }
+}
+
+RecordSchema::RecordSchema(const std::vector<std::string>& fields)
+    : _fields(fields)
+{
+    for (std::vector<std::string>::const_iterator it = _fields.begin(); it != _fields.end(); ++it)
+        _hashes.push_back(ValueKey::hash(it->data(), it->size()));
+}
+
+RecordSchema::ptr RecordSchema::get(const std::vector<std::string>& fields)
+{
+    std::lock_guard<std::mutex> guard(schemas_lock());
+    RecordSchema::ptr &s = schemas()[fields];
+    if (!s)
+        s.reset(new RecordSchema(fields));
+    return s;
+}
+
+int RecordSchema::slot(const char *key, std::size_t len, std::size_t hash) const
+{
+    for (std::size_t i = 0; i < _hashes.size(); ++i)
+        if (_hashes[i] == hash && _fields[i].size() == len &&
+                std::char_traits<char>::compare(_fields[i].data(), key, len) == 0)
+            return i;
+    return -1;
+}
+
+Value RecordSchema::make() const
+{
+    Value ret;
+    new (&ret._kv_array) std::shared_ptr<KeyValueArray>(new KeyValueArray(shared_from_this()));
+    ret._type = Value::kvarray;
+    return ret;
+}
+
+Value RecordSchema::make(const Value& from) const
+{
+    Value ret = make();
+    for (KeyValueArray::const_iterator it = from.KV().begin(); it != from.KV().end(); ++it)
+        ret._kv_array->insert(it->first, it->second);
+    return ret;
 }
 
 bool Value::operator!() const
@@ -569,13 +1170,13 @@ bool Value::operator!() const
         case empty:
             return true;
         case integer:
-            return _imp->_intval == 0;
+            return _intval == 0;
         case string:
-            return _imp->_stringval.empty();
+            return _stringval.empty();
         case array:
-            return _imp->_array->empty();
+            return _array->empty();
         case kvarray:
-            return _imp->_kv_array->empty();
+            return _kv_array->empty();
     }
     throw InternalError("I don't know what type I am. Help.");
 }
@@ -588,10 +1189,10 @@ std::ostream& eir::operator<<(std::ostream & os, const Value & v)
             os << "<null>";
             break;
         case Value::integer:
-            os << v._imp->_intval;
+            os << v._intval;
             break;
         case Value::string:
-            os << v._imp->_stringval;
+            os << v._stringval;
             break;
         case Value::array:
             os << "<Array>";
@@ -626,3 +1227,34 @@ TypeMismatchException::TypeMismatchException(Value::ValueType t1, Value::ValueTy
     : Exception("Type mismatch: expected " + ValueTypeToString(t1) + ", found " + ValueTypeToString(t2))
 {
 }
+
+MemoryUsage memory::value_usage(const Value &v)
+{
+    MemoryUsage u(1, sizeof(Value));
+
+    switch (v.Type())
+    {
+        case Value::empty:
+        case Value::integer:
+            break;
+        case Value::string:
+            u.bytes += memory::string_heap_bytes(v.String());
+            break;
+        case Value::array:
+            u.bytes += sizeof(ValueArray) + sizeof(Implementation<ValueArray>);
+            for (ValueArray::const_iterator it = v.Array().begin(); it != v.Array().end(); ++it)
+                u += value_usage(*it);
+            break;
+        case Value::kvarray:
+            u.bytes += sizeof(KeyValueArray) + v.KV().heap_bytes();
+            for (KeyValueArray::const_iterator it = v.KV().begin(); it != v.KV().end(); ++it)
+            {
+                // The Value object itself is part of the table.
+                u += value_usage(it->second);
+                u.bytes -= sizeof(Value);
+            }
+            break;
+    }
+
+    return u;
+}
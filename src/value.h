@@ -2,6 +2,8 @@
 #define value_h
 
 #include <string>
+#include <vector>
+#include <memory>
 #include <iosfwd>
 
 #include "exceptions.h"
@@ -49,13 +51,102 @@ namespace eir
 
             ValueArray();
             ~ValueArray();
+
+        private:
+            friend class Value;
+            ValueArray(const ValueArray&);
+    };
+
+    /*
+     * A kvarray key whose hash is worked out once, at compile time where the
+     * compiler allows it, rather than on every lookup. String literals used as
+     * keys are turned into one of these automatically; a field that's looked up
+     * in a loop can be hoisted into a static const ValueKey.
+     */
+    class ValueKey
+    {
+        public:
+            // Stops at the first NUL, in case this is a char buffer rather than a literal.
+            template <std::size_t N_>
+            constexpr ValueKey(const char (&s)[N_])
+                : _data(s), _length(literal_length(s, N_ - 1)), _hash(literal_hash(s, literal_length(s, N_ - 1)))
+            { }
+
+            ValueKey(const char *s, std::size_t len)
+                : _data(s), _length(len), _hash(hash(s, len))
+            { }
+
+            constexpr const char *data() const { return _data; }
+            constexpr std::size_t length() const { return _length; }
+            constexpr std::size_t hash() const { return _hash; }
+
+            // FNV-1a; the two versions must agree.
+            static std::size_t hash(const char *s, std::size_t len)
+            {
+                std::size_t h = fnv_offset;
+                for (std::size_t i = 0; i < len; ++i)
+                    h = (h ^ static_cast<unsigned char>(s[i])) * fnv_prime;
+                return h;
+            }
+
+            static constexpr std::size_t literal_length(const char *s, std::size_t max)
+            {
+                return max == 0 || *s == '\0' ? 0 : 1 + literal_length(s + 1, max - 1);
+            }
+
+            static constexpr std::size_t literal_hash(const char *s, std::size_t len, std::size_t h = fnv_offset)
+            {
+                return len == 0 ? h : literal_hash(s + 1, len - 1, (h ^ static_cast<unsigned char>(*s)) * fnv_prime);
+            }
+
+        private:
+            static constexpr std::size_t fnv_offset = 14695981039346656037ULL;
+            static constexpr std::size_t fnv_prime = 1099511628211ULL;
+
+            const char *_data;
+            std::size_t _length;
+            std::size_t _hash;
+    };
+
+    /*
+     * A fixed set of field names shared by many kvarrays of the same shape, such
+     * as the entries of a big list. A kvarray made from a schema keeps one slot
+     * per field instead of a hash node per key, and its keys refer to the
+     * schema's names rather than each holding a copy. It behaves like any other
+     * kvarray: fields not in the schema can still be added, and a field whose
+     * value is empty is treated as absent.
+     */
+    class RecordSchema : public std::enable_shared_from_this<RecordSchema>
+    {
+        public:
+            typedef std::shared_ptr<const RecordSchema> ptr;
+
+            // Schemas are interned; asking for the same field list twice gives the same one.
+            static ptr get(const std::vector<std::string>& fields);
+
+            std::size_t size() const { return _fields.size(); }
+            const std::string& field(std::size_t i) const { return _fields[i]; }
+
+            // The slot index of a field, or -1 if it isn't in this schema.
+            int slot(const char *key, std::size_t len, std::size_t hash) const;
+
+            // An empty record, or one holding the contents of an existing kvarray.
+            Value make() const;
+            Value make(const Value& from) const;
+
+        private:
+            RecordSchema(const std::vector<std::string>& fields);
+
+            std::vector<std::string> _fields;
+            std::vector<std::size_t> _hashes;
     };
 
     class KeyValueArray : public paludis::PrivateImplementationPattern<KeyValueArray>
     {
         public:
             struct KeyValueArrayIteratorTag { };
-            typedef std::pair<const std::string, Value> value_type;
+            // The key is a reference so that records can share their schema's names.
+            typedef std::pair<const std::string&, Value> value_type;
             typedef paludis::WrappedForwardIterator<KeyValueArrayIteratorTag, value_type> iterator;
             typedef paludis::WrappedForwardIterator<KeyValueArrayIteratorTag, const value_type> const_iterator;
 
@@ -67,25 +158,49 @@ namespace eir
             const_iterator begin() const;
             const_iterator end() const;
 
-            iterator find(std::string);
-            const_iterator find(std::string) const;
+            iterator find(const std::string&);
+            const_iterator find(const std::string&) const;
+            iterator find(const ValueKey&);
+            const_iterator find(const ValueKey&) const;
+            template <std::size_t N_> iterator find(const char (&s)[N_]) { return find(ValueKey(s)); }
+            template <std::size_t N_> const_iterator find(const char (&s)[N_]) const { return find(ValueKey(s)); }
 
             size_t size() const;
             bool empty() const;
 
             bool insert(std::string, Value);
 
-            bool erase(std::string);
+            bool erase(const std::string&);
             iterator erase(iterator);
             void clear();
 
-            Value& operator[](std::string);
+            Value& operator[](const std::string&);
+            Value& operator[](const ValueKey&);
+            template <std::size_t N_> Value& operator[](const char (&s)[N_]) { return (*this)[ValueKey(s)]; }
+
+            const RecordSchema *schema() const;
+
+            // Bytes used by the table itself, including the Value objects it holds
+            // but not anything they own.
+            std::size_t heap_bytes() const;
 
             KeyValueArray();
             ~KeyValueArray();
+
+        private:
+            friend class Value;
+            friend class RecordSchema;
+            KeyValueArray(const KeyValueArray&);
+            KeyValueArray(RecordSchema::ptr);
     };
 
-    class Value : public paludis::PrivateImplementationPattern<Value>
+    /*
+     * Copying an array or kvarray Value is cheap: the copies share their contents
+     * until one of them is modified through a non-const accessor, at which point
+     * that one takes a private copy. References or iterators taken into a Value's
+     * contents are invalidated if it is copied and then modified.
+     */
+    class Value
     {
         public:
             enum ValueType
@@ -97,19 +212,40 @@ namespace eir
                 kvarray
             };
 
-            Value();
+            Value() noexcept : _type(empty), _intval(0) { }
             Value(ValueType);
 
-            Value(int);
+            Value(int i) noexcept : _type(integer), _intval(i) { }
             Value(const char *);
             Value(std::string);
 
             Value(const Value&);
+            Value(Value&&) noexcept;
             const Value& operator=(const Value&);
+            const Value& operator=(Value&&) noexcept;
+
+            ~Value() { destroy(); }
+
+            void swap(Value&) noexcept;
 
-            ~Value();
+            // A deep copy, sharing nothing with this one at any level.
+            Value clone() const;
+            // False if this value's array contents are currently shared with a copy.
+            bool unique() const;
+            // True if both are arrays or kvarrays holding the very same contents,
+            // as a copy does until one side is modified.
+            bool shares_contents(const Value&) const;
+            // Deep comparison. Cheap for contents that are shared.
+            bool equals(const Value&) const;
 
-            ValueType Type() const;
+            // Changes whenever an array or kvarray is, or may have been, modified:
+            // any non-const access to its contents through this Value counts. No
+            // two sets of contents ever share a generation, so a Value that has
+            // been replaced outright compares different too. Always 0 for other
+            // types, whose changes aren't tracked.
+            unsigned long generation() const;
+
+            ValueType Type() const { return _type; }
 
             const Value& operator=(int);
             const Value& operator=(const std::string&);
@@ -121,6 +257,8 @@ namespace eir
 
             ValueArray::iterator begin();
             ValueArray::iterator end();
+            ValueArray::const_iterator begin() const;
+            ValueArray::const_iterator end() const;
 
             int Int() const;
             std::string String() const;
@@ -130,8 +268,17 @@ namespace eir
             const KeyValueArray& KV() const;
 
             Value& operator[](const std::string&);
+            Value& operator[](const ValueKey&);
+            template <std::size_t N_> Value& operator[](const char (&s)[N_]) { return (*this)[ValueKey(s)]; }
             Value& operator[](int);
 
+            // Looking up a missing key in a const Value gives an empty Value rather
+            // than adding one.
+            const Value& operator[](const std::string&) const;
+            const Value& operator[](const ValueKey&) const;
+            template <std::size_t N_> const Value& operator[](const char (&s)[N_]) const { return (*this)[ValueKey(s)]; }
+            const Value& operator[](int) const;
+
             void push_back(Value v);
             ValueArray::iterator erase(ValueArray::iterator it);
 
@@ -142,8 +289,33 @@ namespace eir
             bool operator!() const;
 
             friend std::ostream& operator<<(std::ostream&, const Value&);
+            friend class RecordSchema;
+
+        private:
+            // This shouldn't really be mutable, but it lets us initialise an empty type
+            // to a meaningful one in what are still semantically const operations.
+            mutable ValueType _type;
+
+            // Only the member named by _type is live.
+            union
+            {
+                int _intval;
+                std::string _stringval;
+                std::shared_ptr<ValueArray> _array;
+                std::shared_ptr<KeyValueArray> _kv_array;
+            };
+
+            void destroy() noexcept;
+            void construct_from(const Value&);
+            void construct_from(Value&&) noexcept;
+
+            void NeedType(ValueType) const;
+            void NeedType(ValueType);
     };
 
+    inline void swap(Value& lhs, Value& rhs) noexcept
+    { lhs.swap(rhs); }
+
     std::ostream & operator<<(std::ostream&, const Value&);
 
     inline std::string operator+(std::string lhs, const Value& rhs)
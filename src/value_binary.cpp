@@ -0,0 +1,353 @@
+#include "value_binary.h"
+#include "exceptions.h"
+
+#include <paludis/util/stringify.hh>
+
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+
+using namespace eir;
+
+namespace
+{
+    const char magic[4] = { 'E', 'I', 'R', 'V' };
+    const unsigned char flag_checksum = 1;
+
+    // Deeper than anything we store, and shallow enough not to exhaust the stack.
+    const unsigned max_depth = 256;
+
+    enum Tag
+    {
+        tag_empty,
+        tag_integer,
+        tag_string,
+        tag_array,
+        tag_kvarray,
+        tag_record
+    };
+
+    uint32_t crc32(const unsigned char *data, std::size_t len)
+    {
+        // Built once, thread-safely: this runs on loader and writer threads.
+        struct Table
+        {
+            uint32_t entries[256];
+
+            Table()
+            {
+                for (uint32_t i = 0; i < 256; ++i)
+                {
+                    uint32_t c = i;
+                    for (int k = 0; k < 8; ++k)
+                        c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+                    entries[i] = c;
+                }
+            }
+        };
+        static const Table table;
+
+        uint32_t crc = 0xFFFFFFFF;
+        for (std::size_t i = 0; i < len; ++i)
+            crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        return crc ^ 0xFFFFFFFF;
+    }
+
+    void put_varint(std::string &out, uint64_t v)
+    {
+        while (v >= 0x80)
+        {
+            out += char((v & 0x7F) | 0x80);
+            v >>= 7;
+        }
+        out += char(v);
+    }
+
+    void put_string(std::string &out, const std::string &s)
+    {
+        put_varint(out, s.size());
+        out += s;
+    }
+
+    struct Encoder
+    {
+        std::string body;
+
+        std::unordered_map<std::string, uint64_t> key_index;
+        std::vector<const std::string *> keys;
+
+        std::unordered_map<const RecordSchema *, uint64_t> schema_index;
+        std::vector<const RecordSchema *> schemas;
+
+        uint64_t key(const std::string &k)
+        {
+            std::pair<std::unordered_map<std::string, uint64_t>::iterator, bool> r =
+                key_index.insert(std::make_pair(k, keys.size()));
+            if (r.second)
+                keys.push_back(&r.first->first);
+            return r.first->second;
+        }
+
+        uint64_t schema(const RecordSchema *s)
+        {
+            std::pair<std::unordered_map<const RecordSchema *, uint64_t>::iterator, bool> r =
+                schema_index.insert(std::make_pair(s, schemas.size()));
+            if (r.second)
+            {
+                schemas.push_back(s);
+                for (std::size_t i = 0; i < s->size(); ++i)
+                    key(s->field(i));
+            }
+            return r.first->second;
+        }
+
+        void value(const Value &v)
+        {
+            switch (v.Type())
+            {
+                case Value::empty:
+                    body += char(tag_empty);
+                    break;
+                case Value::integer:
+                    {
+                        int64_t i = v.Int();
+                        body += char(tag_integer);
+                        put_varint(body, (uint64_t(i) << 1) ^ uint64_t(i >> 63));
+                        break;
+                    }
+                case Value::string:
+                    body += char(tag_string);
+                    put_string(body, v.String());
+                    break;
+                case Value::array:
+                    body += char(tag_array);
+                    put_varint(body, v.Array().size());
+                    for (ValueArray::const_iterator it = v.Array().begin(); it != v.Array().end(); ++it)
+                        value(*it);
+                    break;
+                case Value::kvarray:
+                    if (const RecordSchema *s = v.KV().schema())
+                    {
+                        body += char(tag_record);
+                        put_varint(body, schema(s));
+                    }
+                    else
+                        body += char(tag_kvarray);
+
+                    put_varint(body, v.KV().size());
+                    for (KeyValueArray::const_iterator it = v.KV().begin(); it != v.KV().end(); ++it)
+                    {
+                        put_varint(body, key(it->first));
+                        value(it->second);
+                    }
+                    break;
+            }
+        }
+    };
+
+    struct Decoder
+    {
+        const unsigned char *p, *end;
+        std::vector<std::string> keys;
+        std::vector<RecordSchema::ptr> schemas;
+
+        Decoder(const unsigned char *b, const unsigned char *e)
+            : p(b), end(e)
+        { }
+
+        void fail(const std::string &what)
+        {
+            throw IOError("Corrupt binary value data: " + what);
+        }
+
+        unsigned char byte()
+        {
+            if (p == end)
+                fail("unexpected end of data");
+            return *p++;
+        }
+
+        uint64_t varint()
+        {
+            uint64_t ret = 0;
+            for (unsigned shift = 0; shift < 64; shift += 7)
+            {
+                unsigned char c = byte();
+                ret |= uint64_t(c & 0x7F) << shift;
+                if (!(c & 0x80))
+                    return ret;
+            }
+            fail("varint too long");
+            return 0;
+        }
+
+        // A count of things each taking at least one byte can't exceed what's left.
+        std::size_t count()
+        {
+            uint64_t n = varint();
+            if (n > uint64_t(end - p))
+                fail("count exceeds data length");
+            return n;
+        }
+
+        std::string string()
+        {
+            std::size_t len = count();
+            std::string ret(reinterpret_cast<const char *>(p), len);
+            p += len;
+            return ret;
+        }
+
+        const std::string &key()
+        {
+            uint64_t i = varint();
+            if (i >= keys.size())
+                fail("key index out of range");
+            return keys[i];
+        }
+
+        const RecordSchema::ptr &schema()
+        {
+            uint64_t i = varint();
+            if (i >= schemas.size())
+                fail("schema index out of range");
+            return schemas[i];
+        }
+
+        void tables()
+        {
+            std::size_t nkeys = count();
+            keys.reserve(nkeys);
+            for (std::size_t i = 0; i < nkeys; ++i)
+                keys.push_back(string());
+
+            std::size_t nschemas = count();
+            for (std::size_t i = 0; i < nschemas; ++i)
+            {
+                std::vector<std::string> fields;
+                std::size_t nfields = count();
+                for (std::size_t f = 0; f < nfields; ++f)
+                    fields.push_back(key());
+                schemas.push_back(RecordSchema::get(fields));
+            }
+        }
+
+        Value value(unsigned depth)
+        {
+            if (depth > max_depth)
+                fail("nested too deeply");
+
+            unsigned char tag = byte();
+            switch (tag)
+            {
+                case tag_empty:
+                    return Value();
+
+                case tag_integer:
+                    {
+                        uint64_t u = varint();
+                        return Value(int(int64_t(u >> 1) ^ -int64_t(u & 1)));
+                    }
+
+                case tag_string:
+                    return Value(string());
+
+                case tag_array:
+                    {
+                        Value ret(Value::array);
+                        std::size_t n = count();
+                        for (std::size_t i = 0; i < n; ++i)
+                            ret.push_back(value(depth + 1));
+                        return ret;
+                    }
+
+                case tag_kvarray:
+                case tag_record:
+                    {
+                        Value ret = tag == tag_record ? schema()->make() : Value(Value::kvarray);
+
+                        KeyValueArray &kv = ret.KV();
+                        std::size_t n = count();
+                        for (std::size_t i = 0; i < n; ++i)
+                        {
+                            const std::string &k = key();
+                            kv.insert(k, value(depth + 1));
+                        }
+                        return ret;
+                    }
+            }
+
+            fail("unknown type tag " + paludis::stringify(int(tag)));
+            return Value();
+        }
+    };
+}
+
+std::string binary::encode(const Value &v, bool checksum)
+{
+    Encoder enc;
+    enc.value(v);
+
+    std::string out(magic, sizeof magic);
+    out += char(format_version);
+    out += char(checksum ? flag_checksum : 0);
+
+    put_varint(out, enc.keys.size());
+    for (std::vector<const std::string *>::iterator it = enc.keys.begin(); it != enc.keys.end(); ++it)
+        put_string(out, **it);
+
+    put_varint(out, enc.schemas.size());
+    for (std::vector<const RecordSchema *>::iterator it = enc.schemas.begin(); it != enc.schemas.end(); ++it)
+    {
+        put_varint(out, (*it)->size());
+        for (std::size_t i = 0; i < (*it)->size(); ++i)
+            put_varint(out, enc.key_index[(*it)->field(i)]);
+    }
+
+    out += enc.body;
+
+    if (checksum)
+    {
+        uint32_t crc = crc32(reinterpret_cast<const unsigned char *>(out.data()), out.size());
+        for (int i = 0; i < 4; ++i)
+            out += char((crc >> (8 * i)) & 0xFF);
+    }
+
+    return out;
+}
+
+Value binary::decode(const std::string &data)
+{
+    const unsigned char *begin = reinterpret_cast<const unsigned char *>(data.data());
+    const unsigned char *end = begin + data.size();
+
+    if (data.size() < sizeof magic + 2 || data.compare(0, sizeof magic, magic, sizeof magic) != 0)
+        throw IOError("Not a binary value file");
+
+    unsigned char version = begin[sizeof magic], flags = begin[sizeof magic + 1];
+    if (version > format_version)
+        throw IOError("Binary value file is version " + paludis::stringify(int(version)) +
+                      ", which is newer than this version of eir understands");
+
+    if (flags & flag_checksum)
+    {
+        if (data.size() < sizeof magic + 2 + 4)
+            throw IOError("Corrupt binary value data: missing checksum");
+        end -= 4;
+
+        uint32_t stored = 0;
+        for (int i = 0; i < 4; ++i)
+            stored |= uint32_t(end[i]) << (8 * i);
+        if (crc32(begin, end - begin) != stored)
+            throw IOError("Corrupt binary value data: checksum mismatch");
+    }
+
+    Decoder dec(begin + sizeof magic + 2, end);
+    dec.tables();
+    Value ret = dec.value(0);
+
+    if (dec.p != end)
+        dec.fail("trailing data");
+
+    return ret;
+}
@@ -0,0 +1,27 @@
+#ifndef value_binary_h
+#define value_binary_h
+
+#include "value.h"
+
+#include <string>
+
+namespace eir
+{
+    /*
+     * A compact, versioned binary encoding of a Value tree. Integers are
+     * zigzag varints, strings are length-prefixed, kvarray keys and record
+     * schemas are written once in tables at the front and referred to by
+     * index, and an optional CRC-32 of the whole encoding follows at the end.
+     */
+    namespace binary
+    {
+        const unsigned char format_version = 1;
+
+        std::string encode(const Value &v, bool checksum = true);
+
+        // Throws IOError if the data is truncated, corrupt, or from a newer version.
+        Value decode(const std::string &data);
+    }
+}
+
+#endif
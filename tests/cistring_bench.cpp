@@ -0,0 +1,85 @@
+/*
+ * Times lookups in nick-keyed maps of various sizes, as the bot's client and
+ * channel maps are, with cistring's hasher and with its ordering. Build and
+ * run it with tests/run.sh.
+ */
+
+#include "string_util.h"
+
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+using namespace eir;
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    std::vector<std::string> make_nicks(std::size_t n, std::mt19937 & rng)
+    {
+        const char alphabet[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ[]{}\\|^_-0123456789";
+        std::vector<std::string> nicks;
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            std::string nick;
+            for (int len = 4 + rng() % 12; len > 0; --len)
+                nick += alphabet[rng() % (sizeof alphabet - 1)];
+            nicks.push_back(nick + std::to_string(i));
+        }
+        return nicks;
+    }
+
+    // Looks up upper-cased spellings, so that every lookup has to fold case.
+    template <typename Map_>
+    double ns_per_lookup(const Map_ & map, const std::vector<std::string> & keys)
+    {
+        const int rounds = 2000000 / keys.size() + 1;
+        std::size_t found = 0;
+
+        Clock::time_point start = Clock::now();
+        for (int r = 0; r < rounds; ++r)
+            for (std::vector<std::string>::const_iterator it = keys.begin(); it != keys.end(); ++it)
+                found += map.count(*it);
+        Clock::time_point end = Clock::now();
+
+        if (found != rounds * keys.size())
+            std::cerr << "lookups failed" << std::endl;
+
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / double(rounds * keys.size());
+    }
+}
+
+int main()
+{
+    std::mt19937 rng(1);
+
+    for (std::size_t n : { 1000, 10000, 100000 })
+    {
+        std::vector<std::string> nicks = make_nicks(n, rng), keys;
+        for (std::vector<std::string>::iterator it = nicks.begin(); it != nicks.end(); ++it)
+        {
+            std::string key = *it;
+            for (std::string::size_type i = 0; i < key.size(); ++i)
+                if (key[i] >= 'a' && key[i] <= 'z')
+                    key[i] -= 'a' - 'A';
+            keys.push_back(key);
+        }
+
+        std::unordered_map<std::string, int, cistring::hasher, cistring::is_equal> hashed;
+        std::map<std::string, int, cistring::is_less> ordered;
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            hashed[nicks[i]] = i;
+            ordered[nicks[i]] = i;
+        }
+
+        std::cout << n << " nicks: unordered_map " << ns_per_lookup(hashed, keys) << " ns/lookup, "
+                  << "map " << ns_per_lookup(ordered, keys) << " ns/lookup" << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,130 @@
+/*
+ * Checks that cistring's hash, equality and ordering agree with each other
+ * under every casemapping: strings that compare equal must hash the same,
+ * and equal must mean neither is less than the other. Build and run it with
+ * tests/run.sh.
+ */
+
+#include "string_util.h"
+
+#include <iostream>
+#include <random>
+#include <vector>
+#include <unordered_map>
+
+using namespace eir;
+
+namespace
+{
+    int failures = 0;
+
+    void fail(const std::string & what)
+    {
+        if (++failures <= 20)
+            std::cerr << "FAIL: " << what << std::endl;
+    }
+
+    void check_pair(const std::string & a, const std::string & b, const unsigned char *tab, const char *name)
+    {
+        bool eq = cistring::equal(a, b, tab);
+
+        if (eq && cistring::hash(a, tab) != cistring::hash(b, tab))
+            fail(std::string(name) + ": '" + a + "' and '" + b + "' are equal but hash differently");
+
+        if (eq != (!cistring::less(a, b, tab) && !cistring::less(b, a, tab)))
+            fail(std::string(name) + ": equal and less disagree on '" + a + "' and '" + b + "'");
+    }
+
+    void check_known(const std::string & a, const std::string & b, bool expected, const unsigned char *tab, const char *name)
+    {
+        if (cistring::equal(a, b, tab) != expected)
+            fail(std::string(name) + ": expected '" + a + "' and '" + b + "' to be " + (expected ? "equal" : "different"));
+    }
+}
+
+int main()
+{
+    struct { cistring::casemapping mapping; const char *name; } mappings[] = {
+        { cistring::rfc1459, "rfc1459" },
+        { cistring::strict_rfc1459, "strict-rfc1459" },
+        { cistring::ascii, "ascii" },
+    };
+
+    std::mt19937 rng(1);
+
+    for (auto & m : mappings)
+    {
+        const unsigned char *tab = cistring::table_for(m.mapping);
+
+        // Every pair of single characters.
+        for (int i = 0; i < 256; ++i)
+            for (int j = 0; j < 256; ++j)
+                check_pair(std::string(1, char(i)), std::string(1, char(j)), tab, m.name);
+
+        // Each character's equivalents under this mapping.
+        std::vector<std::vector<char> > equivalents(256);
+        for (int i = 0; i < 256; ++i)
+            for (int j = 0; j < 256; ++j)
+                if (tab[i] == tab[j])
+                    equivalents[i].push_back(char(j));
+
+        // Random strings of lengths either side of the hash's eight-byte steps,
+        // against a random spelling of the same string, and against a neighbour.
+        const char alphabet[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ[]{}\\|^~-_`0123456789";
+        cistring::hasher hasher(tab);
+        cistring::is_equal is_equal(tab);
+        std::unordered_map<std::string, int, cistring::hasher, cistring::is_equal> map(16, hasher, is_equal);
+
+        for (int n = 0; n < 20000; ++n)
+        {
+            std::string a;
+            for (int len = rng() % 40; len > 0; --len)
+                a += alphabet[rng() % (sizeof alphabet - 1)];
+
+            std::string b;
+            for (std::string::size_type i = 0; i < a.size(); ++i)
+            {
+                const std::vector<char> & e = equivalents[(unsigned char)a[i]];
+                b += e[rng() % e.size()];
+            }
+
+            if (!cistring::equal(a, b, tab))
+                fail(std::string(m.name) + ": '" + a + "' and '" + b + "' should be equal");
+            check_pair(a, b, tab, m.name);
+
+            std::string c = a;
+            if (!c.empty())
+                c[rng() % c.size()] = alphabet[rng() % (sizeof alphabet - 1)];
+            check_pair(a, c, tab, m.name);
+
+            map[a] = n;
+            if (map.find(b) == map.end() || map.find(b)->second != n)
+                fail(std::string(m.name) + ": '" + b + "' doesn't find '" + a + "' in an unordered_map");
+        }
+    }
+
+    const unsigned char *rfc = cistring::table_for(cistring::rfc1459),
+                        *strict = cistring::table_for(cistring::strict_rfc1459),
+                        *ascii = cistring::table_for(cistring::ascii);
+
+    check_known("Nick[]\\~", "nick{}|^", true, rfc, "rfc1459");
+    check_known("Nick[]\\", "nick{}|", true, strict, "strict-rfc1459");
+    check_known("~", "^", false, strict, "strict-rfc1459");
+    check_known("NICK", "nick", true, ascii, "ascii");
+    check_known("[", "{", false, ascii, "ascii");
+
+    cistring::casemapping parsed;
+    if (!cistring::parse_casemapping("strict-rfc1459", parsed) || parsed != cistring::strict_rfc1459)
+        fail("parse_casemapping doesn't recognise strict-rfc1459");
+    if (cistring::parse_casemapping("utf-8", parsed))
+        fail("parse_casemapping accepts utf-8");
+
+    if (failures)
+    {
+        std::cerr << failures << " failures" << std::endl;
+        return 1;
+    }
+
+    std::cout << "cistring_check: ok" << std::endl;
+    return 0;
+}
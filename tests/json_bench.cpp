@@ -0,0 +1,133 @@
+/*
+ * Times the json storage backend on lists of 1k to 1M entries: writing
+ * them out in both formats, parsing them back, and looking fields up in
+ * what was parsed. It checks each round trip as it goes. The writer and
+ * parser live in the module, so it's built in directly. Build and run it
+ * with tests/run.sh; sizes given on the command line replace the defaults.
+ */
+
+#include "../modules/storage/json.cpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    double ms_since(Clock::time_point start)
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count() / 1000.0;
+    }
+
+    // Shaped like a large ban list, with strings that need escaping.
+    Value make_list(int n)
+    {
+        Value list(Value::array);
+        for (int i = 0; i < n; ++i)
+        {
+            Value entry(Value::kvarray);
+            entry["mask"] = "*!*@host" + paludis::stringify(i) + ".example.com";
+            entry["setter"] = std::string("admin\"quoted\"\ttab");
+            entry["reason"] = std::string("some reason text \\ with a backslash and \xc3\xa9");
+            entry["set"] = 1600000000 + i;
+            entry["expires"] = -i;
+            list.push_back(entry);
+        }
+        return list;
+    }
+
+    double write(const Value & list, const std::string & filename, bool pretty)
+    {
+        Clock::time_point start = Clock::now();
+        AtomicFileWriter file(filename);
+        JsonWriter(file, pretty).value(list);
+        file.put('\n');
+        file.commit();
+        return ms_since(start);
+    }
+
+    double parse(const std::string & filename, Value & into)
+    {
+        Clock::time_point start = Clock::now();
+        MappedFile file(filename);
+        into = JsonParser(file.begin(), file.end()).parse();
+        return ms_since(start);
+    }
+
+    // Looks up three fields by name in every entry, as the expiry sweeps do.
+    double ns_per_lookup(const Value & list)
+    {
+        const std::string setter("admin\"quoted\"\ttab");
+        long long total = 0;
+        std::size_t matched = 0;
+
+        Clock::time_point start = Clock::now();
+        for (ValueArray::const_iterator it = list.begin(); it != list.end(); ++it)
+        {
+            const Value & entry = *it;
+            total += entry["expires"].Int() + entry["set"].Int();
+            if (entry["setter"] == setter)
+                ++matched;
+        }
+        double ms = ms_since(start);
+
+        if (matched != list.Array().size() || total == 0)
+            std::cerr << "lookups failed" << std::endl;
+
+        return ms * 1e6 / (3.0 * list.Array().size());
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<int> sizes;
+    for (int i = 1; i < argc; ++i)
+        sizes.push_back(std::atoi(argv[i]));
+    if (sizes.empty())
+        sizes = { 1000, 10000, 100000, 1000000 };
+
+    std::string filename(DATADIR "/json_bench.json");
+    int failures = 0;
+
+    std::cout << "entries  format     size   write ms   parse ms   ns/lookup" << std::endl;
+
+    for (std::vector<int>::iterator n = sizes.begin(); n != sizes.end(); ++n)
+    {
+        Value list = make_list(*n);
+
+        for (bool pretty : { true, false })
+        {
+            double write_ms = write(list, filename, pretty);
+
+            struct stat st;
+            stat(filename.c_str(), &st);
+
+            Value read;
+            double parse_ms = parse(filename, read);
+            double lookup_ns = ns_per_lookup(read);
+
+            bool ok = read.equals(list);
+            if (!ok)
+                ++failures;
+
+            std::cout.setf(std::ios::fixed);
+            std::cout.precision(1);
+            std::cout.width(7);
+            std::cout << *n << "  " << (pretty ? "pretty " : "compact") << " ";
+            std::cout.width(6);
+            std::cout << (st.st_size >> 10) << "K ";
+            std::cout.width(10);
+            std::cout << write_ms << " ";
+            std::cout.width(10);
+            std::cout << parse_ms << " ";
+            std::cout.width(11);
+            std::cout << lookup_ns << (ok ? "" : "  round trip FAILED") << std::endl;
+        }
+    }
+
+    unlink(filename.c_str());
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,46 @@
+#!/bin/sh
+#
+# Builds and runs the checks and benchmarks in this directory against the
+# sources in the tree, without needing a configured build. Run it from the
+# top of the tree:
+#
+#   tests/run.sh              runs cistring_check
+#   tests/run.sh bench        also runs cistring_bench and json_bench
+#
+# CXX and CXXFLAGS are honoured; benchmark numbers want an optimised build.
+# JSON_BENCH_SIZES, if set, replaces json_bench's default list sizes.
+
+set -e
+
+: ${CXX:=g++}
+: ${CXXFLAGS:=-O2}
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+mkdir "$work/data"
+
+cat > "$work/paths.h" <<END
+#define MODDIR "$work"
+#define ETCDIR "$work"
+#define DATADIR "$work/data"
+END
+
+sources="$(ls src/*.cpp | grep -v '^src/main.cpp$') $(ls paludis/util/*.cc)"
+
+build()
+{
+    name=$1
+    shift
+    $CXX $CXXFLAGS -std=c++0x -I. -Isrc -include "$work/paths.h" tests/$name.cpp "$@" -o "$work/$name" -lpthread -ldl
+}
+
+build cistring_check src/string_util.cpp
+"$work/cistring_check"
+
+if [ "$1" = bench ]; then
+    build cistring_bench src/string_util.cpp
+    "$work/cistring_bench"
+
+    build json_bench $sources
+    "$work/json_bench" $JSON_BENCH_SIZES
+fi